@@ -0,0 +1,186 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory_resource>
+#include <vector>
+#include <casport.h>
+
+// Throughput and latency of the library hot paths. Output is CSV on stdout:
+//   benchmark,mix,elements,points,iterations,ns_per_iteration,ns_per_point
+// Run with --quick for a short smoke run.
+
+namespace {
+
+typedef enum mix { SERIES_ONLY = 0, SHUNT_ONLY = 1, ALTERNATING = 2 } mix_t;
+const char *mix_names[] = { "series", "shunt", "alternating" };
+
+double g_min_time = 0.2; // seconds per measurement
+volatile double g_sink;  // keeps results alive
+
+casport::mount_t
+mount_of(const mix_t mix, const std::size_t i) {
+	switch (mix) {
+	case SERIES_ONLY: return casport::SERIES;
+	case SHUNT_ONLY: return casport::SHUNT;
+	case ALTERNATING: break;
+	}
+	return (i % 2) ? casport::SERIES : casport::SHUNT;
+}
+
+casport::circuit
+make_circuit(const std::size_t n, const mix_t mix,
+	std::pmr::memory_resource *mr = std::pmr::get_default_resource()) {
+	casport::circuit c(50.0, mr);
+	for (std::size_t i = 0; i < n; i++) {
+		c.push_front(casport::element(casport::RES, mount_of(mix, i), 1.0 + 0.01 * i));
+	}
+	return c;
+}
+
+// Repeat fn until g_min_time has passed, returns ns per call
+double
+measure(const std::function<void()> &fn, std::size_t &iterations) {
+	typedef std::chrono::steady_clock clock_t;
+	fn(); // warm up
+	iterations = 0;
+	std::size_t batch = 1;
+	const clock_t::time_point start = clock_t::now();
+	double elapsed = 0.0;
+	while (elapsed < g_min_time) {
+		for (std::size_t i = 0; i < batch; i++) { fn(); }
+		iterations += batch;
+		batch *= 2;
+		elapsed = std::chrono::duration<double>(clock_t::now() - start).count();
+	}
+	return 1.0e9 * elapsed / iterations;
+}
+
+void
+report(const char *name, const char *mix, const std::size_t elements, const std::size_t points,
+	const std::function<void()> &fn) {
+	std::size_t iterations;
+	const double ns = measure(fn, iterations);
+	printf("%s,%s,%zu,%zu,%zu,%.3f,%.6f\n", name, mix, elements, points, iterations, ns,
+		ns / static_cast<double>(points));
+	fflush(stdout);
+}
+
+}
+
+int main(int argc, char const *argv[])
+{
+	bool quick = false;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--quick") == 0) {
+			quick = true;
+		} else {
+			fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (quick) { g_min_time = 0.01; }
+
+	const std::vector<std::size_t> counts = quick ?
+		std::vector<std::size_t>{ 1, 10, 100 } :
+		std::vector<std::size_t>{ 1, 10, 100, 1000, 10000 };
+	const std::vector<std::size_t> lengths = quick ?
+		std::vector<std::size_t>{ 1, 64, 1000 } :
+		std::vector<std::size_t>{ 1, 64, 1000, 10000, 100000, 1000000 };
+
+	printf("benchmark,mix,elements,points,iterations,ns_per_iteration,ns_per_point\n");
+
+	// Latency of a single point evaluation
+	for (int m = 0; m < 3; m++) {
+		for (const std::size_t n : counts) {
+			const casport::circuit c = make_circuit(n, static_cast<mix_t>(m));
+			report("input_impedance", mix_names[m], n, 1, [&]{
+				g_sink = std::real(c.input_impedance());
+			});
+		}
+	}
+
+	// Sweep throughput against element count and sweep length. The precision
+	// overload bypasses the sweep memo, which would answer every repeat.
+	for (int m = 0; m < 3; m++) {
+		for (const std::size_t n : counts) {
+			const casport::circuit c = make_circuit(n, static_cast<mix_t>(m));
+			for (const std::size_t len : lengths) {
+				if (n * len > (quick ? 100000u : 100000000u)) { continue; }
+				std::vector<double> f(len);
+				std::vector<cxd_t> zin(len);
+				for (std::size_t i = 0; i < len; i++) { f[i] = 1.0e6 * (i + 1); }
+				report("sweep", mix_names[m], n, len, [&]{
+					c.input_impedance(f.data(), len, zin.data(), casport::DOUBLE_PRECISION);
+					g_sink = std::real(zin[0]);
+				});
+			}
+		}
+	}
+
+	// Repeated sweeps of an unchanged circuit, recalled from the sweep memo
+	for (const std::size_t n : counts) {
+		const casport::circuit c = make_circuit(n, ALTERNATING);
+		const std::size_t len = 1000;
+		std::vector<double> f(len);
+		std::vector<cxd_t> zin(len);
+		for (std::size_t i = 0; i < len; i++) { f[i] = 1.0e6 * (i + 1); }
+		report("sweep_memo_hit", "alternating", n, len, [&]{
+			c.input_impedance(f.data(), len, zin.data());
+			g_sink = std::real(zin[0]);
+		});
+	}
+
+	// Sweep by precision, these bypass the sweep memo
+	const char *precision_names[] = { "sweep_double", "sweep_single", "sweep_mixed" };
+	for (int p = 0; p < 3; p++) {
+		for (const std::size_t n : counts) {
+			const casport::circuit c = make_circuit(n, ALTERNATING);
+			const std::size_t len = quick ? 1000 : 100000;
+			if (n * len > (quick ? 100000u : 100000000u)) { continue; }
+			std::vector<double> f(len);
+			std::vector<cxd_t> zin(len);
+			for (std::size_t i = 0; i < len; i++) { f[i] = 1.0e6 * (i + 1); }
+			report(precision_names[p], "alternating", n, len, [&]{
+				c.input_impedance(f.data(), len, zin.data(), static_cast<casport::precision_t>(p));
+				g_sink = std::real(zin[0]);
+			});
+		}
+	}
+
+	// Element construction
+	report("element_construct", "series", 1, 1, [&]{
+		const casport::element e(casport::RES, casport::SERIES, 100.0);
+		g_sink = std::real(e.value());
+	});
+	report("element_construct", "shunt", 1, 1, [&]{
+		const casport::element e(casport::RES, casport::SHUNT, 100.0);
+		g_sink = std::real(e.value());
+	});
+
+	// Circuit construction and push_front into circuits of growing size
+	for (const std::size_t n : counts) {
+		report("circuit_build", "alternating", n, 1, [&]{
+			const casport::circuit c = make_circuit(n, ALTERNATING);
+			g_sink = static_cast<double>(c.size());
+		});
+	}
+	for (const std::size_t n : counts) {
+		std::vector<char> buffer(1 << 20);
+		std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+		report("circuit_build_arena", "alternating", n, 1, [&]{
+			arena.release();
+			const casport::circuit c = make_circuit(n, ALTERNATING, &arena);
+			g_sink = static_cast<double>(c.size());
+		});
+	}
+	for (const std::size_t n : counts) {
+		casport::circuit c = make_circuit(n, ALTERNATING);
+		const casport::element e(casport::RES, casport::SERIES, 1.0);
+		report("push_front_pop_front", "series", n, 1, [&]{
+			c.push_front(e);
+			c.pop_front();
+		});
+	}
+	return 0;
+}
@@ -6,10 +6,16 @@ int main(int argc, char const *argv[])
 	casport::circuit my_circuit = casport::circuit(200.0);
 	std::cout << "input impedance of circuit: " << my_circuit.input_impedance() << std::endl;
 
-	my_circuit.push_front( std::make_shared<casport::element>(casport::RES, casport::SERIES, 100.0) );
-	my_circuit.push_front( std::make_shared<casport::element>(casport::RES, casport::SERIES, 100.0) );
+	my_circuit.push_front( casport::element(casport::RES, casport::SERIES, 100.0) );
+	my_circuit.push_front( casport::element(casport::RES, casport::SERIES, 100.0) );
 	std::cout << "input impedance of circuit: " << my_circuit.input_impedance() << std::endl;
 
+	double f[4] = { 1.0e9, 2.0e9, 3.0e9, 4.0e9 };
+	cxd_t zin[4];
+	my_circuit.input_impedance(f, 4, zin);
+	for (int i = 0; i < 4; i++) {
+		std::cout << "f: " << f[i] << " Zin: " << zin[i] << std::endl;
+	}
 
 	//std::cout << "Usage: " << argv[0] << std::endl;
 	/* code */
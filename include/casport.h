@@ -5,33 +5,265 @@
 #include <complex>
 #include <cmath>
 #include <vector>
+#include <functional>
+#include <iterator>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <cstdint>
+#include "casport_trace.h"
 
 typedef std::complex<double> cxd_t;
 inline constexpr double C0 = 299792458.0;
 inline constexpr double C0_REC = 3.33564095198152049575;
+inline constexpr std::size_t SWEEP_BLOCK = 64; // frequency points per chain walk in sweeps
+inline constexpr double DEFAULT_FREQUENCY = 1.0e9; // operating point of new elements and circuits [Hz]
+inline constexpr double DEFAULT_Z0 = 50.0; // of lines and stubs made without a characteristic impedance [ohm]
+inline constexpr double NOISE_T0 = 290.0; // reference temperature of noise figures [K]
 
 namespace casport {
-typedef enum emt { TRL = 0, CAP = 1, IND = 2, RES = 3, OCS = 4, SCS = 5} element_t;
+typedef enum emt { TRL = 0, CAP = 1, IND = 2, RES = 3, OCS = 4, SCS = 5, SUB = 6} element_t; // SUB: subcircuit
 typedef enum mnt { SHUNT = 0, SERIES = 1} mount_t;
 
+typedef enum prc { DOUBLE_PRECISION = 0, SINGLE_PRECISION = 1, MIXED_PRECISION = 2 } precision_t;
+
+// SWEEP_BLOCK 2x2 matrices in split real/imag storage, one lane per frequency.
+// T is double, or float for single precision sweeps.
+template<typename T>
+struct abcd_soa_t {
+	alignas(64) T a_re[SWEEP_BLOCK];
+	alignas(64) T a_im[SWEEP_BLOCK];
+	alignas(64) T b_re[SWEEP_BLOCK];
+	alignas(64) T b_im[SWEEP_BLOCK];
+	alignas(64) T c_re[SWEEP_BLOCK];
+	alignas(64) T c_im[SWEEP_BLOCK];
+	alignas(64) T d_re[SWEEP_BLOCK];
+	alignas(64) T d_im[SWEEP_BLOCK];
+	void identity(const std::size_t n) {
+		for (std::size_t i = 0; i < n; i++) {
+			a_re[i] = T(1); a_im[i] = T(0);
+			b_re[i] = T(0); b_im[i] = T(0);
+			c_re[i] = T(0); c_im[i] = T(0);
+			d_re[i] = T(1); d_im[i] = T(0);
+		}
+	}
+};
+typedef abcd_soa_t<double> abcd_soa;
+
+// Caller owned split real/imag arrays of n two-port matrices, p11 p12 p21 p22
+typedef struct network_soa {
+	double *re[4];
+	double *im[4];
+} network_soa_t;
+
+// Element math shared by element and static_circuit, so both give identical results
+namespace detail {
+// Phase of a line of length l [m] per Hz, theta = phase_per_hz(l) * f
+inline double
+phase_per_hz(const double l) {
+	return 2.0 * M_PI * l * C0_REC * 1.0e-9;
+}
+
+// Impedance of a lumped element or stub at f [Hz], v is R [ohm], C [F], L [H]
+// or the stub length [m], z0 the stub characteristic impedance
+inline cxd_t
+impedance(const element_t e, const cxd_t v, const double z0, const double f) {
+	switch (e) {
+	case RES:
+		return v;
+	case CAP:
+		return 1.0 / (cxd_t(0.0, 2.0 * M_PI * f) * v);
+	case IND:
+		return cxd_t(0.0, 2.0 * M_PI * f) * v;
+	case OCS: {
+		const double t = phase_per_hz(std::real(v)) * f;
+		return cxd_t(0.0, -z0 * std::cos(t) / std::sin(t));
+		}
+	case SCS: {
+		const double t = phase_per_hz(std::real(v)) * f;
+		return cxd_t(0.0, z0 * std::sin(t) / std::cos(t));
+		}
+	case TRL:
+	case SUB:
+		break;
+	}
+	return cxd_t(0.0, 0.0);
+}
+
+inline cxd_t
+admittance(const element_t e, const cxd_t v, const double z0, const double f) {
+	switch (e) {
+	case RES:
+		return 1.0 / v;
+	case CAP:
+		return cxd_t(0.0, 2.0 * M_PI * f) * v;
+	case IND:
+		return 1.0 / (cxd_t(0.0, 2.0 * M_PI * f) * v);
+	case OCS: {
+		const double t = phase_per_hz(std::real(v)) * f;
+		return cxd_t(0.0, std::sin(t) / (z0 * std::cos(t)));
+		}
+	case SCS: {
+		const double t = phase_per_hz(std::real(v)) * f;
+		return cxd_t(0.0, -std::cos(t) / (z0 * std::sin(t)));
+		}
+	case TRL:
+	case SUB:
+		break;
+	}
+	return cxd_t(0.0, 0.0);
+}
+
+// Line of length l [m], characteristic impedance z0 and attenuation alpha [Np/m]
+inline void
+trl_abcd(const double l, const double z0, const double alpha, const double f, cxd_t *m) {
+	const double theta = phase_per_hz(l) * f;
+	const double c = std::cos(theta), s = std::sin(theta);
+	const double ch = std::cosh(alpha * l), sh = std::sinh(alpha * l);
+	const cxd_t cg = cxd_t(ch * c, sh * s); // cosh(gamma l)
+	const cxd_t sg = cxd_t(sh * c, ch * s); // sinh(gamma l)
+	m[0] = cg;
+	m[1] = z0 * sg;
+	m[2] = sg / z0;
+	m[3] = cg;
+}
+
+// General left multiply, abcd = t * abcd
+inline void
+flma2(const cxd_t *t, cxd_t *abcd) {
+	const cxd_t a = t[0] * abcd[0] + t[1] * abcd[2];
+	const cxd_t b = t[0] * abcd[1] + t[1] * abcd[3];
+	const cxd_t c = t[2] * abcd[0] + t[3] * abcd[2];
+	const cxd_t d = t[2] * abcd[1] + t[3] * abcd[3];
+	abcd[0] = a;
+	abcd[1] = b;
+	abcd[2] = c;
+	abcd[3] = d;
+}
+
+// Row update, left multiply abcd by the series/shunt element matrix
+template <mount_t M>
+inline void
+flma(const cxd_t x, cxd_t *abcd) {
+	if constexpr (M == SHUNT) {
+		abcd[2] += x * abcd[0];
+		abcd[3] += x * abcd[1];
+	} else {
+		abcd[0] += x * abcd[2];
+		abcd[1] += x * abcd[3];
+	}
+}
+}
+
+class subcircuit;
+
 class element {
 	public:
+		// Lines and stubs made from a value alone get z0 = DEFAULT_Z0
 		element(const casport::element_t e,const casport::mount_t m, const cxd_t v);
 		element(const casport::element_t e,const casport::mount_t m, const double v);
 		element(const double l, const double z0); // TRL
-		bool is_series() { return (m_mount == SERIES); };
-		bool is_shunt() { return (m_mount == SHUNT); };
-		void flma(cxd_t *abcd);
-		~element();
+		element(const double l, const double z0, const double alpha); // lossy TRL, alpha [Np/m]
+		element(const casport::element_t e,const casport::mount_t m, const double l, const double z0); // OCS, SCS
+		// TRL is mounted SERIES by every constructor, there are no shunt lines
+		explicit element(const subcircuit &block); // SUB, the block must outlive the element
+		bool is_series() const { return (m_mount == SERIES); };
+		bool is_shunt() const { return (m_mount == SHUNT); };
+		bool is_line() const { return (m_component == TRL); };
+		bool is_block() const { return (m_component == SUB); };
+		bool is_two_port() const { return is_line() || is_block(); }; // general two-port, no immittance
+		bool is_constant() const { return (m_component == RES); }; // frequency independent
+		bool is_stub() const { return (m_component == OCS || m_component == SCS); };
+		cxd_t immittance(const double f) const; // Z if series, Y if shunt, at f [Hz]
+		cxd_t immittance(const double f, const double scale) const; // with value * scale
+		void immittance(const double *f, const std::size_t n, double *x_re, double *x_im) const;
+		// Same from sweep tables, f_rec = 1/f, cos/sin of the phase of this element's length (stubs).
+		// Tables and lanes below are double, or float for single and mixed precision sweeps.
+		template<typename T>
+		void immittance(const double *f, const T *f_rec, const T *cos_t, const T *sin_t,
+			const std::size_t n, T *x_re, T *x_im) const;
+		element_t component() const { return m_component; };
+		mount_t mount() const { return m_mount; };
+		cxd_t value() const { return m_value; };
+		double z0() const { return m_z0; };
+		double alpha() const { return m_alpha; };
+		double frequency() const { return m_frequency; };
+		const subcircuit *block() const { return m_block; }; // SUB, nullptr otherwise
+		void set_frequency(const double f); // moves the operating point
+		void abcd(cxd_t *m) const; // full row major 2x2 at the operating point
+		void abcd(const double f, cxd_t *m) const; // at f
+		void dabcd(cxd_t *dm) const; // d(abcd)/d(value) at the operating point
+		void set_value(const cxd_t v);
+		void set_value(const double v) { set_value(cxd_t(v, 0.0)); };
+		void flma(cxd_t *abcd) const;
+		void flma(abcd_soa &abcd, const double *f, const std::size_t n) const; // lane i at f[i]
+		template<typename A, typename T>
+		void flma(abcd_soa_t<A> &abcd, const T *x_re, const T *x_im, const std::size_t n) const;
+		template<typename A>
+		void flma(abcd_soa_t<A> &abcd, const cxd_t x, const std::size_t n) const;
+		void flma(abcd_soa &abcd, const double f, const double *scale, const std::size_t n) const; // lane i with value * scale[i]
+		// TRL with the line phase already tabulated, cos/sin(theta) per lane
+		template<typename A, typename T>
+		void flma_trl(abcd_soa_t<A> &abcd, const T *cos_t, const T *sin_t, const std::size_t n) const;
+		// General two-port per lane, m = { a_re, a_im, b_re, b_im, c_re, c_im, d_re, d_im } lane arrays
+		template<typename A>
+		void flma_two_port(abcd_soa_t<A> &abcd, const double *const *m, const std::size_t n) const;
 	private:
+		void update();
 		element_t m_component;
 		mount_t m_mount;
-		cxd_t m_abcd[3]; // a b c, d omitted
+		cxd_t m_value;      // R [ohm], C [F], L [H] or TRL/stub length [m]
+		double m_z0;        // TRL and stub characteristic impedance
+		double m_alpha;     // TRL attenuation [Np/m]
+		double m_frequency; // operating point [Hz]
+		const subcircuit *m_block; // SUB
+		cxd_t m_abcd[4]; // row major at the operating point
 		cxd_t m_impedance;
 		cxd_t m_admittance;
 };
-typedef	std::vector<std::shared_ptr<element> > elements_vec_t;
+// Elements are stored by value, contiguous and in chain order
+typedef	std::pmr::vector<element> elements_vec_t;
+
+// Contiguous elements with free slots kept at both ends, like the leaves of
+// abcd_tree, so pushes and pops at either end are amortized O(1). Insert and
+// erase in the middle move the elements after the position.
+class element_array {
+public:
+	explicit element_array(std::pmr::memory_resource *mr = std::pmr::get_default_resource()) :
+		m_store(mr), m_first(0), m_size(0) {};
+	element_array(const element_array &a, std::pmr::memory_resource *mr) :
+		m_store(a.m_store, mr), m_first(a.m_first), m_size(a.m_size) {};
+	element_array(const element_array &) = default;
+	element_array &operator=(const element_array &) = default;
+	element_array(element_array &&) = default;
+	element_array &operator=(element_array &&) = default;
+	std::size_t size() const { return m_size; };
+	bool empty() const { return m_size == 0; };
+	element &operator[](const std::size_t i) { return m_store[m_first + i]; };
+	const element &operator[](const std::size_t i) const { return m_store[m_first + i]; };
+	element &front() { return m_store[m_first]; };
+	const element &front() const { return m_store[m_first]; };
+	element &back() { return m_store[m_first + m_size - 1]; };
+	const element &back() const { return m_store[m_first + m_size - 1]; };
+	element *begin() { return m_store.data() + m_first; };
+	element *end() { return begin() + m_size; };
+	const element *begin() const { return m_store.data() + m_first; };
+	const element *end() const { return begin() + m_size; };
+	std::reverse_iterator<const element *> crbegin() const { return std::reverse_iterator<const element *>(end()); };
+	std::reverse_iterator<const element *> crend() const { return std::reverse_iterator<const element *>(begin()); };
+	void reserve(const std::size_t n); // n elements fit at either end without reallocation
+	void push_back(const element &e);
+	void push_front(const element &e);
+	void pop_back() { m_size--; };
+	void pop_front() { m_first++; m_size--; };
+	void insert(const std::size_t i, const element &e); // before element i
+	void erase(const std::size_t i);
+private:
+	void resize(const std::size_t capacity);
+	std::pmr::vector<element> m_store; // free slots hold copies of some element
+	std::size_t m_first; // slot of element 0
+	std::size_t m_size;
+};
 
 /*
 class shunt_element: public element
@@ -47,19 +279,190 @@ private:
 };
 */
 
+// Cached partial ABCD products of a chain. A segment tree whose root is
+// E[0]*E[1]*...*E[n-1], with identity leaves kept as headroom at both ends
+// so that end pushes/pops and single element updates cost O(log n).
+class abcd_tree {
+public:
+	explicit abcd_tree(std::pmr::memory_resource *mr = std::pmr::get_default_resource());
+	abcd_tree(const abcd_tree &t, std::pmr::memory_resource *mr);
+	abcd_tree(const abcd_tree &) = default;
+	abcd_tree &operator=(const abcd_tree &) = default;
+	abcd_tree(abcd_tree &&) = default;
+	abcd_tree &operator=(abcd_tree &&) = default;
+	void reserve(const std::size_t n); // room for n elements without reallocation
+	void assign(const element *elements, const std::size_t n); // O(n) rebuild
+	void update(const std::size_t i, const element &e);
+	void push_front(const element &e);
+	void push_back(const element &e);
+	void pop_front();
+	void pop_back();
+	const cxd_t *product() const { return m_nodes[1].m; }; // row major
+	std::size_t size() const { return m_size; };
+private:
+	struct mat2 { cxd_t m[4]; };
+	void resize(const std::size_t capacity);
+	void pull(std::size_t leaf);
+	std::size_t m_capacity; // leaves, power of two
+	std::size_t m_first;    // leaf of chain element 0
+	std::size_t m_size;
+	std::pmr::vector<mat2> m_nodes; // heap order, root at 1, leaves at m_capacity...
+};
+
+class plan;
+class thread_pool;
+
+// Stable reference to an element of a circuit. Stays valid across pushes and
+// pops at either end, insert and erase in the middle invalidate the handles
+// of the elements after the position.
+typedef struct element_handle {
+	std::ptrdiff_t id;
+} element_handle_t;
+
+// Result of the last sweep of a circuit, reused while neither the circuit
+// revision nor the frequency grid changes. Copies start out empty.
+class sweep_memo {
+public:
+	sweep_memo() : m_revision(0) {};
+	sweep_memo(const sweep_memo &) : m_revision(0) {};
+	sweep_memo &operator=(const sweep_memo &) { clear(); return *this; };
+	bool recall(const std::uint64_t revision, const double *f, const std::size_t n, cxd_t *zin) const;
+	void store(const std::uint64_t revision, const double *f, const std::size_t n, const cxd_t *zin);
+	void clear();
+private:
+	mutable std::mutex m_lock;
+	std::uint64_t m_revision; // 0 when empty
+	std::vector<double> m_f;
+	std::vector<cxd_t> m_zin;
+};
 
+// Const member functions only read the circuit and may be called from several
+// threads at once, mutation needs exclusive access.
+// Element storage and the cached products come from the memory resource given
+// at construction, e.g. a std::pmr::monotonic_buffer_resource shared by many
+// short lived circuits and released in one go. The resource must outlive the
+// circuit. Plain copies allocate from the default resource.
 class circuit {
 public:
 	circuit();
 	circuit(const cxd_t z0);
 	circuit(const double z0);
+	circuit(const cxd_t z0, std::pmr::memory_resource *mr);
+	circuit(const double z0, std::pmr::memory_resource *mr);
+	// Elements chain[0..n) from the input towards the load, built in one pass
+	circuit(const cxd_t z0, const element *chain, const std::size_t n,
+		std::pmr::memory_resource *mr = std::pmr::get_default_resource());
+	circuit(const circuit &c, std::pmr::memory_resource *mr); // copy into mr
+	circuit(const circuit &) = default;
+	circuit &operator=(const circuit &) = default;
+	circuit(circuit &&) = default;
+	circuit &operator=(circuit &&) = default;
 	~circuit();
-	cxd_t input_impedance();
-	void push_back(std::shared_ptr<element> e_ptr);
-	void push_front(std::shared_ptr<element> e_ptr);
+	void reserve(const std::size_t n); // room for n elements, load included
+	cxd_t input_impedance() const; // O(1), at the operating point, from the cached chain product
+	void input_impedance(const double *f, const std::size_t n, cxd_t *zin) const; // sweep, zin[n], memoized
+	// Sweep in the given precision, not memoized. SINGLE_PRECISION runs the whole
+	// chain in float, MIXED_PRECISION keeps float tables and accumulates in double.
+	void input_impedance(const double *f, const std::size_t n, cxd_t *zin, const precision_t precision) const;
+	// Sweep of the two-port ahead of the load, the last element, abcd[4n] row major per point
+	void abcd(const double *f, const std::size_t n, cxd_t *abcd) const;
+	void abcd(const double *f, const std::size_t n, const network_soa_t &abcd) const;
+	// Noise figure [dB] of the two-port ahead of the load fed from z_source, nf[n], with
+	// every lossy element at temperature [K]. Zin comes out of the same walk when zin is given.
+	void noise_figure(const double *f, const std::size_t n, const cxd_t z_source, double *nf,
+		cxd_t *zin = nullptr, const double temperature = NOISE_T0) const;
+	cxd_t z0() const { return m_z0; }; // termination given at construction
+	std::uint64_t revision() const { return m_revision; }; // changes on every mutation
+	double frequency() const { return m_frequency; };
+	void set_frequency(const double f); // operating point of every element, O(n)
+	// dZin/d(value) of every element at the operating point, grad[size()]
+	void sensitivities(cxd_t *grad) const;
+	std::vector<cxd_t> sensitivities() const;
+	plan compile() const; // reduced evaluation plan of the current chain
+	element_handle_t push_back(const element &e); // at either end O(log n)
+	element_handle_t push_front(const element &e);
+	void pop_back();
+	void pop_front();
+	element_handle_t insert(const std::size_t i, const element &e); // before element i, O(n)
+	void erase(const std::size_t i); // O(n)
+	void replace(const std::size_t i, const element &e); // O(log n)
+	// Shared elements are copied in, later edits through e_ptr do not reach the circuit
+	element_handle_t push_back(const std::shared_ptr<element> &e_ptr) { return push_back(*e_ptr); };
+	element_handle_t push_front(const std::shared_ptr<element> &e_ptr) { return push_front(*e_ptr); };
+	// In place value update, no allocation, O(log n)
+	void set_value(const element_handle_t h, const cxd_t v);
+	void set_value(const element_handle_t h, const double v) { set_value(h, cxd_t(v, 0.0)); };
+	element_handle_t handle(const std::size_t i) const { return element_handle_t{ m_front + static_cast<std::ptrdiff_t>(i) }; };
+	std::size_t index(const element_handle_t h) const { return static_cast<std::size_t>(h.id - m_front); };
+	std::size_t size() const { return m_elements.size(); };
+	const element &operator[](const std::size_t i) const { return m_elements[i]; };
+	const element &operator[](const element_handle_t h) const { return m_elements[index(h)]; };
 private:
 	cxd_t m_z0;
-	elements_vec_t m_elements;
+	element_array m_elements;
+	abcd_tree m_tree;
+	std::ptrdiff_t m_front; // handle id of element 0
+	double m_frequency;
+	std::uint64_t m_revision;
+	mutable sweep_memo m_memo;
+	cxd_t walk() const;
+	void sweep(const double *f, const std::size_t n, cxd_t *zin) const; // no memo
+	template<typename T, typename A> // tables, accumulation
+	void chain(const double *f, const std::size_t n, const std::size_t n_el,
+		const std::function<void(const std::size_t k, const std::size_t m, const abcd_soa_t<A> &abcd)> &emit) const;
+	friend void parallel_input_impedance(thread_pool &pool, const circuit &c,
+		const double *f, const std::size_t n, cxd_t *zin);
+	friend void parallel_input_impedance(thread_pool &pool, const circuit *c, const std::size_t n_circuits,
+		const double *f, const std::size_t n, cxd_t *zin);
+};
+
+// Immutable evaluation plan made by circuit::compile(). Runs of series (shunt)
+// elements are fused into one series (shunt) step with the summed impedance
+// (admittance), and runs of frequency independent steps are pre-multiplied
+// into one constant 2x2 matrix.
+class plan {
+public:
+	cxd_t input_impedance(const double f) const;
+	void input_impedance(const double *f, const std::size_t n, cxd_t *zin) const; // sweep, zin[n]
+	std::size_t size() const { return m_steps.size(); }; // steps per frequency point
+private:
+	friend class circuit;
+	typedef enum stp { ROW = 0, MATRIX = 1, LINE = 2 } step_t;
+	struct step {
+		step_t kind;
+		mount_t mount;     // ROW
+		cxd_t x;           // ROW, summed constant immittance
+		std::size_t first; // ROW, frequency dependent terms in m_terms, LINE the line or subcircuit
+		std::size_t count;
+		cxd_t m[4];        // MATRIX, row major
+	};
+	void push_row(const mount_t mount, const cxd_t x, const elements_vec_t &terms);
+	std::vector<step> m_steps; // chain order
+	elements_vec_t m_terms;
+};
+
+
+// A circuit used as a general two-port inside other circuits via element(block).
+// The two-port is the chain without its load. Every instance points to the same
+// subcircuit, which keeps the ABCD sweep over the last whole grid it was asked
+// for, so sweeps of the outer circuit evaluate each block once however many
+// times it is used. Not changed after construction.
+class subcircuit {
+public:
+	explicit subcircuit(const circuit &c);
+	subcircuit(const subcircuit &) = delete;
+	subcircuit &operator=(const subcircuit &) = delete;
+	// Rows a_re, a_im, b_re, b_im, c_re, c_im, d_re, d_im of n points each
+	typedef std::shared_ptr<const std::vector<double>> table_t;
+	const circuit &chain() const { return m_circuit; };
+	void abcd(const double f, cxd_t *m) const; // row major at f
+	void abcd(const double *f, const std::size_t n, abcd_soa &m) const; // n <= SWEEP_BLOCK, not cached
+	table_t sweep(const double *f, const std::size_t n) const; // cached while the grid stays the same
+private:
+	circuit m_circuit;
+	mutable std::mutex m_lock;
+	mutable std::vector<double> m_f;
+	mutable table_t m_table;
 };
 
 }
@@ -0,0 +1,66 @@
+#ifndef INCLUDED_CASPORT_ADAPTIVE_H
+#define INCLUDED_CASPORT_ADAPTIVE_H
+
+#include <vector>
+#include "casport.h"
+
+namespace casport {
+
+typedef struct adaptive_options {
+	double tol;             // relative error of the model at the check points
+	std::size_t initial;    // points of the first, uniform, pass
+	std::size_t max_points; // circuit evaluations
+	std::size_t max_order;  // support points of the model
+} adaptive_options_t;
+
+inline constexpr adaptive_options_t DEFAULT_ADAPTIVE_OPTIONS = { 1.0e-6, 33, 4096, 100 };
+
+// Barycentric rational model of Zin(f), r(f) = sum w_k z_k / (x - x_k) / sum w_k / (x - x_k)
+// with x the frequency mapped onto [-1, 1]. Made by the AAA algorithm, which
+// picks support points greedily and solves a Loewner least squares problem for
+// the weights; residuals are taken relative to |z| so small and large
+// impedances are fitted alike.
+class rational_model {
+public:
+	rational_model() : m_center(0.0), m_scale(1.0), m_evaluations(0), m_error(0.0), m_converged(false) {};
+	static rational_model fit(const double *f, const cxd_t *z, const std::size_t n, const double tol,
+		const std::size_t max_order);
+	cxd_t operator()(const double f) const;
+	void evaluate(const double *f, const std::size_t n, cxd_t *z) const;
+	std::size_t order() const { return m_support.size(); };
+	std::size_t evaluations() const { return m_evaluations; }; // of the circuit, adaptive_sweep
+	double error() const { return m_error; }; // largest relative error at the last checks, or the samples of fit()
+	bool converged() const { return m_converged; }; // every check passed within max_points, or fit() met tol
+private:
+	friend rational_model adaptive_sweep(const circuit &c, const double f_lo, const double f_hi,
+		const adaptive_options_t &options);
+	// fit() with the support points first taken from seed, the frequencies of a
+	// previous fit, in picked the frequencies of the new one
+	static rational_model aaa(const double *f, const cxd_t *z, const std::size_t n, const double tol,
+		const std::size_t max_order, const std::vector<double> &seed, std::vector<double> &picked);
+	double m_center; // f = m_center + m_scale * x
+	double m_scale;
+	std::vector<double> m_support; // x_k
+	std::vector<cxd_t> m_values;   // z_k
+	std::vector<cxd_t> m_weights;  // w_k
+	std::size_t m_evaluations;
+	double m_error;
+	bool m_converged;
+};
+
+// Adaptive sweep of c over [f_lo, f_hi]. A uniform pass is fitted, then every
+// interval between samples is checked at its midpoint and split where the model
+// misses the circuit by more than options.tol, until all checks pass or
+// options.max_points evaluations are spent. Smooth responses need a small
+// fraction of the points of a dense sweep. When f_hi is not above f_lo the
+// model is the constant at f_lo from one evaluation, converged only if they
+// are equal.
+rational_model adaptive_sweep(const circuit &c, const double f_lo, const double f_hi,
+	const adaptive_options_t &options = DEFAULT_ADAPTIVE_OPTIONS);
+// Same over the span of f[0..n), resampled onto f, zin[n]
+rational_model adaptive_sweep(const circuit &c, const double *f, const std::size_t n, cxd_t *zin,
+	const adaptive_options_t &options = DEFAULT_ADAPTIVE_OPTIONS);
+
+}
+
+#endif //INCLUDED_CASPORT_ADAPTIVE_H
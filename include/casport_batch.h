@@ -0,0 +1,57 @@
+#ifndef INCLUDED_CASPORT_BATCH_H
+#define INCLUDED_CASPORT_BATCH_H
+
+#include <vector>
+#include "casport.h"
+#include "casport_device.h"
+#include "casport_parallel.h"
+
+namespace casport {
+
+// Many variants of one topology. The component/mount sequence, line and stub
+// impedances and losses are kept once; element values are stored per element
+// as contiguous real and imaginary planes over variants and evaluated
+// SWEEP_BLOCK variants at a time, one variant per SIMD lane. Values are R
+// [ohm], C [F], L [H], complex as in element, or the length [m] of lines and
+// stubs, whose imaginary part is not used.
+// With a device backend the values stay on the device between sweeps and are
+// sent again after values() (non const) or set_value(). The device takes real
+// values only, batches with an imaginary part are swept on the CPU.
+class circuit_batch {
+public:
+	circuit_batch(const circuit &topology, const std::size_t variants); // every variant at the topology values
+	std::size_t size() const { return m_topology.size(); }; // elements per variant
+	std::size_t variants() const { return m_variants; };
+	const element &operator[](const std::size_t i) const { return m_topology[i]; };
+	double *values(const std::size_t i) { m_revision++; return m_values.data() + i * m_variants; }; // of element i, by variant
+	const double *values(const std::size_t i) const { return m_values.data() + i * m_variants; };
+	double *imag_values(const std::size_t i) { m_revision++; return m_imag.data() + i * m_variants; };
+	const double *imag_values(const std::size_t i) const { return m_imag.data() + i * m_variants; };
+	cxd_t value(const std::size_t i, const std::size_t variant) const {
+		return cxd_t(m_values[i * m_variants + variant], m_imag[i * m_variants + variant]); };
+	void set_value(const std::size_t i, const std::size_t variant, const cxd_t v) {
+		m_revision++; m_values[i * m_variants + variant] = std::real(v); m_imag[i * m_variants + variant] = std::imag(v); };
+	backend_t backend() const { return m_backend; };
+	void set_backend(const backend_t b) { m_backend = b; };
+	// zin[v*n + k] is variant v at f[k]
+	void input_impedance(const double *f, const std::size_t n, cxd_t *zin) const;
+	void input_impedance(thread_pool &pool, const double *f, const std::size_t n, cxd_t *zin) const;
+	// Variants [first, first + count), zin[v*n + k] is variant first + v at f[k]
+	void input_impedance(const double *f, const std::size_t n, const std::size_t first,
+		const std::size_t count, cxd_t *zin) const;
+private:
+	void block(const double f, const std::size_t first, const std::size_t count, abcd_soa &abcd) const;
+	void sweep(const double *f, const std::size_t n, const std::size_t first, const std::size_t count, cxd_t *zin) const; // CPU
+	bool device_sweep(const double *f, const std::size_t n, const std::size_t first, const std::size_t count, cxd_t *zin) const;
+	circuit m_topology;
+	std::size_t m_variants;
+	std::vector<double> m_values; // size() x m_variants, real parts
+	std::vector<double> m_imag;   // imaginary parts
+	std::uint64_t m_revision; // of m_values
+	backend_t m_backend;
+	mutable device_cache m_device;
+};
+
+}
+
+#endif //INCLUDED_CASPORT_BATCH_H
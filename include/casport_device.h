@@ -0,0 +1,40 @@
+#ifndef INCLUDED_CASPORT_DEVICE_H
+#define INCLUDED_CASPORT_DEVICE_H
+
+#include <cstdint>
+#include <mutex>
+
+namespace casport {
+// Where circuit_batch and monte_carlo sweeps run. AUTO_BACKEND takes the GPU for
+// sweeps of at least DEVICE_MIN_POINTS points when the library was built with
+// CASPORT_CUDA and a device is present, the CPU otherwise. A sweep that fails on
+// the device is redone on the CPU.
+typedef enum bke { AUTO_BACKEND = 0, CPU_BACKEND = 1, CUDA_BACKEND = 2 } backend_t;
+
+inline constexpr std::size_t DEVICE_MIN_POINTS = std::size_t(1) << 16; // variants x frequencies
+inline constexpr std::size_t DEVICE_CHUNK_POINTS = std::size_t(1) << 22; // per device launch
+
+bool backend_available(const backend_t b);
+
+namespace device { struct tables; }
+
+// Element tables of one sweep owner kept on the device between sweeps, sent
+// again when the owner's revision moves on. Copies start out empty.
+class device_cache {
+public:
+	device_cache() : m_tables(nullptr), m_revision(0) {};
+	device_cache(const device_cache &) : device_cache() {};
+	device_cache &operator=(const device_cache &) { clear(); return *this; };
+	~device_cache() { clear(); };
+	void clear();
+private:
+	friend class circuit_batch;
+	friend class monte_carlo;
+	std::mutex m_lock; // one device sweep at a time
+	device::tables *m_tables;
+	std::uint64_t m_revision; // of the owner when sent, 0 when empty
+};
+
+}
+
+#endif //INCLUDED_CASPORT_DEVICE_H
@@ -0,0 +1,124 @@
+#ifndef INCLUDED_CASPORT_LIBRARY_H
+#define INCLUDED_CASPORT_LIBRARY_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "casport.h"
+
+// Binary circuit libraries. A library file holds many circuits as flat arrays
+// that are memory mapped read only and evaluated where they lie, so opening
+// one costs a check of its index and element kinds and the pages are shared by
+// every process mapping the same file.
+//
+// Layout, version 2, native byte order (checked on open), C circuits holding E
+// elements in all, load elements included. A 64 byte header
+//   char magic[8] "CASPLIB", u32 version, u32 byte order mark 0x01020304,
+//   u64 C, u64 E, u64 names bytes, u64 file size, u64 reserved[2]
+// is followed by the u64 offsets of the sections, each 64 byte aligned:
+//   u64 first[C+1]      elements of circuit i are [first[i], first[i+1])
+//   f64 z0[2C]          circuit termination, re/im pairs
+//   f64 frequency[C]    circuit operating point [Hz]
+//   u64 name[C+1]       names of circuit i are bytes [name[i], name[i+1])
+//   u64 by_name[C]      circuit indices in name order
+//   u8  component[E]    element_t
+//   u8  mount[E]        mount_t
+//   f64 value[2E]       re/im pairs
+//   f64 impedance[E]    line and stub z0
+//   f64 alpha[E]        line attenuation [Np/m]
+//   char names[]
+namespace casport {
+
+inline constexpr std::uint32_t LIBRARY_VERSION = 2;
+
+typedef struct library_error {
+	const char *message; // static string, nullptr on success
+} library_error_t;
+
+// Collects circuits and writes them as one library file
+class library_writer {
+public:
+	// Subcircuits (SUB elements) are not stored, add() returns false for them
+	bool add(const circuit &c, const std::string_view name = std::string_view());
+	std::size_t size() const { return m_first.size() - 1; };
+	library_error_t write(const char *path) const;
+	std::vector<unsigned char> image() const; // the file contents
+private:
+	std::vector<std::uint64_t> m_first{ 0 };
+	std::vector<double> m_z0;
+	std::vector<double> m_frequency;
+	std::vector<std::uint64_t> m_name{ 0 };
+	std::vector<unsigned char> m_component;
+	std::vector<unsigned char> m_mount;
+	std::vector<double> m_value;
+	std::vector<double> m_impedance;
+	std::vector<double> m_alpha;
+	std::string m_names;
+};
+
+class circuit_library;
+
+// One circuit of a library, a few pointers into the mapping. Valid while the
+// library stays open.
+class circuit_view {
+public:
+	std::size_t size() const { return m_size; }; // elements, load included
+	cxd_t z0() const { return cxd_t(m_z0[0], m_z0[1]); };
+	double frequency() const { return *m_frequency; }; // operating point when added
+	std::string_view name() const { return m_name; };
+	element operator[](const std::size_t i) const; // built on demand
+	cxd_t input_impedance(const double f) const;
+	void input_impedance(const double *f, const std::size_t n, cxd_t *zin) const; // sweep, zin[n]
+	// At the stored operating point
+	circuit to_circuit(std::pmr::memory_resource *mr = std::pmr::get_default_resource()) const;
+private:
+	friend class circuit_library;
+	std::size_t m_size;
+	const double *m_z0;
+	const double *m_frequency;
+	std::string_view m_name;
+	const unsigned char *m_component;
+	const unsigned char *m_mount;
+	const double *m_value;
+	const double *m_impedance;
+	const double *m_alpha;
+};
+
+// A library file, memory mapped, or a library image in caller memory
+class circuit_library {
+public:
+	circuit_library();
+	~circuit_library();
+	circuit_library(const circuit_library &) = delete;
+	circuit_library &operator=(const circuit_library &) = delete;
+	circuit_library(circuit_library &&other);
+	circuit_library &operator=(circuit_library &&other);
+	library_error_t open(const char *path);
+	// data must stay valid and be 8 byte aligned, it is not copied
+	library_error_t open(const void *data, const std::size_t size);
+	void close();
+	std::size_t size() const { return m_circuits; };
+	circuit_view operator[](const std::size_t i) const;
+	bool find(const std::string_view name, std::size_t &i) const; // O(log size())
+private:
+	const unsigned char *m_data;
+	std::size_t m_bytes;
+	bool m_mapped;
+	std::size_t m_circuits;
+	const std::uint64_t *m_first;
+	const double *m_z0;
+	const double *m_frequency;
+	const std::uint64_t *m_name;
+	const std::uint64_t *m_by_name;
+	const unsigned char *m_component;
+	const unsigned char *m_mount;
+	const double *m_value;
+	const double *m_impedance;
+	const double *m_alpha;
+	const char *m_names;
+};
+
+}
+
+#endif //INCLUDED_CASPORT_LIBRARY_H
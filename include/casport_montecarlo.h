@@ -0,0 +1,59 @@
+#ifndef INCLUDED_CASPORT_MONTECARLO_H
+#define INCLUDED_CASPORT_MONTECARLO_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "casport.h"
+#include "casport_device.h"
+#include "casport_parallel.h"
+
+namespace casport {
+typedef enum dst { FIXED = 0, UNIFORM = 1, GAUSSIAN = 2 } distribution_t;
+
+// Relative tolerance of an element value. UNIFORM draws from v*(1 +- tol),
+// GAUSSIAN from v*(1 + tol*N(0, 1)).
+typedef struct tolerance {
+	distribution_t dist;
+	double tol;
+} tolerance_t;
+
+// Monte Carlo tolerance analysis of a circuit. Element values are drawn from a
+// counter based generator keyed on (seed, element, trial), so every trial is
+// reproducible whatever the batching or thread count. Trials are evaluated in
+// batches of SWEEP_BLOCK, one trial per SIMD lane, without building elements.
+// A device backend draws the same values on the device from the tolerances,
+// circuits with complex element values stay on the CPU.
+class monte_carlo {
+public:
+	monte_carlo(const circuit &c, const std::uint64_t seed);
+	backend_t backend() const { return m_backend; };
+	void set_backend(const backend_t b) { m_backend = b; };
+	void set_tolerance(const std::size_t i, const tolerance_t t); // element i of the circuit
+	// Every element of a kind but the load, varied by index only, c.size() - 1
+	void set_tolerance(const element_t component, const tolerance_t t);
+	double scale(const std::size_t i, const std::uint64_t trial) const; // value multiplier
+	// zin[t*n + k] is trial first + t at f[k]
+	void run(const double *f, const std::size_t n, const std::uint64_t first,
+		const std::size_t trials, cxd_t *zin) const;
+	void run(thread_pool &pool, const double *f, const std::size_t n, const std::uint64_t first,
+		const std::size_t trials, cxd_t *zin) const;
+	// Fraction of trials [0, trials) for which pass(zin, n) holds over the grid f
+	double yield(thread_pool &pool, const double *f, const std::size_t n, const std::uint64_t trials,
+		const std::function<bool(const cxd_t *zin, const std::size_t n)> &pass) const;
+private:
+	void batch(const double *f, const std::size_t n, const std::uint64_t first,
+		const std::size_t trials, double *scales, cxd_t *zin) const;
+	bool device_run(const double *f, const std::size_t n, const std::uint64_t first,
+		const std::size_t trials, cxd_t *zin) const;
+	circuit m_circuit;
+	std::vector<tolerance_t> m_tolerances;
+	std::uint64_t m_seed;
+	std::uint64_t m_revision; // of m_tolerances
+	backend_t m_backend;
+	mutable device_cache m_device;
+};
+
+}
+
+#endif //INCLUDED_CASPORT_MONTECARLO_H
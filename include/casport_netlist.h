@@ -0,0 +1,39 @@
+#ifndef INCLUDED_CASPORT_NETLIST_H
+#define INCLUDED_CASPORT_NETLIST_H
+
+#include <string_view>
+#include <vector>
+#include "casport.h"
+
+// Text netlists, one element or directive per line, from the input towards the load:
+//
+//   # matcher              comment, also after a statement
+//   z0 50                  load impedance [ohm], default 50
+//   f 2.4G                 operating frequency [Hz]
+//   RES SERIES 10          RES, CAP, IND: mount and R [ohm], C [F] or L [H]
+//   CAP SHUNT 1.5p
+//   TRL 12.5m 50 0.1       line length [m], z0 [ohm] and optional loss [Np/m]
+//   OCS SHUNT 8m 60        OCS, SCS: mount, stub length [m] and z0 [ohm]
+//   end                    closes a circuit, a library holds several
+//
+// Component values must be positive and every circuit needs an element.
+// Keywords are case insensitive. Numbers take an optional SI suffix
+// f p n u m k M G T. Parsing works in place on the text, tokens are views
+// into it and numbers are read with std::from_chars.
+namespace casport {
+
+typedef struct netlist_error {
+	std::size_t line;    // 1 based, 0 when parsing succeeded
+	const char *message; // static string, nullptr when parsing succeeded
+} netlist_error_t;
+
+// Exactly one circuit, the closing end is optional. c is assigned and keeps
+// the memory resource it was constructed with.
+netlist_error_t parse_netlist(const std::string_view text, circuit &c);
+// Every circuit of a library is appended to circuits, built in mr, stops at the first error
+netlist_error_t parse_netlists(const std::string_view text, std::vector<circuit> &circuits,
+	std::pmr::memory_resource *mr = std::pmr::get_default_resource());
+
+}
+
+#endif //INCLUDED_CASPORT_NETLIST_H
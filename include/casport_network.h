@@ -0,0 +1,40 @@
+#ifndef INCLUDED_CASPORT_NETWORK_H
+#define INCLUDED_CASPORT_NETWORK_H
+
+#include "casport.h"
+
+// Network parameters of two-ports from their ABCD matrices. Matrices are row
+// major, [p11 p12; p21 p22], and both ports share the real reference z_ref.
+// T chains like ABCD, [a1 b1] = T [b2 a2], so T11 = 1/S21.
+namespace casport {
+typedef enum npm {
+	ABCD_PARAMETERS = 0, S_PARAMETERS = 1, Z_PARAMETERS = 2, Y_PARAMETERS = 3, T_PARAMETERS = 4
+} parameters_t;
+
+// n matrices at once from split storage, out may be abcd itself
+void convert(const network_soa_t &abcd, const std::size_t n, const parameters_t to, const double z_ref,
+	const network_soa_t &out);
+// Sweep of the two-port of c ahead of the load, converted in place in out
+void sweep(const circuit &c, const double *f, const std::size_t n, const parameters_t to, const double z_ref,
+	const network_soa_t &out);
+
+// S of one two-port
+inline void
+s_from_abcd(const cxd_t *abcd, const double z_ref, cxd_t *s) {
+	const cxd_t a = abcd[0], b = abcd[1] / z_ref, c = abcd[2] * z_ref, d = abcd[3];
+	const cxd_t den = a + b + c + d;
+	s[0] = (a + b - c - d) / den;
+	s[1] = 2.0 * (abcd[0] * abcd[3] - abcd[1] * abcd[2]) / den;
+	s[2] = 2.0 / den;
+	s[3] = (-a + b - c + d) / den;
+}
+
+// S11 of a one-port with input impedance zin
+inline cxd_t
+reflection(const cxd_t zin, const double z_ref) {
+	return (zin - z_ref) / (zin + z_ref);
+}
+
+}
+
+#endif //INCLUDED_CASPORT_NETWORK_H
@@ -0,0 +1,61 @@
+#ifndef INCLUDED_CASPORT_PARALLEL_H
+#define INCLUDED_CASPORT_PARALLEL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "casport.h"
+
+namespace casport {
+
+inline constexpr std::size_t SWEEP_CHUNK = 4 * SWEEP_BLOCK; // points per parallel sweep task
+
+// Reusable pool of worker threads. parallel_for hands every thread a contiguous
+// share of the tasks, idle threads steal half of the remaining share of another.
+// The calling thread takes part; nested calls from inside a task run serially.
+class thread_pool {
+public:
+	explicit thread_pool(const std::size_t threads = 0); // 0: one per hardware thread
+	~thread_pool();
+	thread_pool(const thread_pool &) = delete;
+	thread_pool &operator=(const thread_pool &) = delete;
+	std::size_t size() const { return m_threads.size() + 1; }; // including the caller
+	// Run fn(i) for i in [0, n) and wait, the first exception thrown is rethrown here
+	void parallel_for(const std::size_t n, const std::function<void(std::size_t)> &fn);
+private:
+	struct alignas(64) range {
+		std::mutex lock;
+		std::size_t begin;
+		std::size_t end;
+	};
+	void worker(const std::size_t id);
+	void drain(const std::size_t id);
+	bool next(const std::size_t id, std::size_t &task);
+	std::vector<std::thread> m_threads;
+	std::unique_ptr<range[]> m_ranges; // one per thread, caller last
+	std::mutex m_run;  // one parallel_for at a time
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	const std::function<void(std::size_t)> *m_fn;
+	std::exception_ptr m_error;
+	std::uint64_t m_generation;
+	std::size_t m_active;
+	bool m_stop;
+};
+
+// Sweep of one circuit, the grid is split in SWEEP_CHUNK point tasks
+void parallel_input_impedance(thread_pool &pool, const circuit &c,
+	const double *f, const std::size_t n, cxd_t *zin);
+// Independent circuits over one grid, zin[i*n + k] is circuit i at f[k]
+void parallel_input_impedance(thread_pool &pool, const circuit *c, const std::size_t n_circuits,
+	const double *f, const std::size_t n, cxd_t *zin);
+
+}
+
+#endif //INCLUDED_CASPORT_PARALLEL_H
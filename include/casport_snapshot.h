@@ -0,0 +1,44 @@
+#ifndef INCLUDED_CASPORT_SNAPSHOT_H
+#define INCLUDED_CASPORT_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "casport.h"
+
+namespace casport {
+
+// Immutable version of a circuit. Holders can evaluate it from any thread for
+// as long as they keep it, whatever is published after.
+typedef std::shared_ptr<const circuit> circuit_snapshot_t;
+
+// One circuit shared between an editing thread and many evaluating threads.
+// Readers take the current snapshot with an atomic load and never wait for a
+// writer; writers build the next version on a private copy and publish it with
+// an atomic store, so they never wait for sweeps running on older versions.
+// A version is freed when its last reader lets go of it.
+class shared_circuit {
+public:
+	explicit shared_circuit(const circuit &c);
+	explicit shared_circuit(circuit &&c);
+	shared_circuit(const shared_circuit &) = delete;
+	shared_circuit &operator=(const shared_circuit &) = delete;
+	circuit_snapshot_t snapshot() const { return std::atomic_load_explicit(&m_current, std::memory_order_acquire); };
+	std::uint64_t version() const { return m_version.load(std::memory_order_acquire); }; // publishes so far
+	void publish(const circuit &c);
+	void publish(circuit &&c);
+	// Copy on write, edit applies to a copy of the current version which then
+	// replaces it. Writers are serialized, readers are not involved.
+	void update(const std::function<void(circuit &c)> &edit);
+private:
+	void store(circuit_snapshot_t next);
+	circuit_snapshot_t m_current; // only through std::atomic_load/atomic_store
+	std::atomic<std::uint64_t> m_version;
+	std::mutex m_write;
+};
+
+}
+
+#endif //INCLUDED_CASPORT_SNAPSHOT_H
@@ -0,0 +1,98 @@
+#ifndef INCLUDED_CASPORT_STATIC_H
+#define INCLUDED_CASPORT_STATIC_H
+
+#include <array>
+#include <tuple>
+#include <utility>
+#include "casport.h"
+
+// Compile time circuits for fixed topologies:
+//
+//   casport::static_circuit<casport::Series<casport::Res>, casport::Shunt<casport::Res>> c(50.0);
+//   c.values = { 100.0, 200.0 };
+//   cxd_t zin = c.input_impedance(1.0e9);
+//
+// The cascade is unrolled at build time with no mount checks or pointer walks.
+// Element math comes from casport::detail, the same code element uses, so the
+// result is bit identical to the element walk over the equivalent circuit
+// (circuit(z0) with the slots in order in front of the termination, each
+// element's flma() applied from the load forward, the walk
+// circuit::input_impedance() takes when a trace sink is set). Only the tree
+// products of circuit::input_impedance() and the FMA kernels of its sweeps
+// round differently, agreeing to a few ulp per element.
+namespace casport {
+
+// Component tags
+struct Trl { static constexpr element_t component = TRL; };
+struct Cap { static constexpr element_t component = CAP; };
+struct Ind { static constexpr element_t component = IND; };
+struct Res { static constexpr element_t component = RES; };
+struct Ocs { static constexpr element_t component = OCS; };
+struct Scs { static constexpr element_t component = SCS; };
+
+// Mount of a slot
+template <class C>
+struct Series {
+	static constexpr element_t component = C::component;
+	static constexpr mount_t mount = SERIES;
+};
+
+template <class C>
+struct Shunt {
+	static constexpr element_t component = C::component;
+	static constexpr mount_t mount = SHUNT;
+};
+
+template <class... Slots>
+class static_circuit {
+public:
+	static constexpr std::size_t size = sizeof...(Slots);
+	explicit static_circuit(const double z0 = 50.0) : z0(cxd_t(z0, 0.0)) {
+		values.fill(0.0);
+		impedances.fill(50.0);
+	};
+	static_circuit(const double z0, const std::array<double, sizeof...(Slots)> &v) :
+		values(v), z0(cxd_t(z0, 0.0)) { impedances.fill(50.0); };
+
+	cxd_t input_impedance(const double f) const {
+		cxd_t abcd[4] = { cxd_t(1.0, 0.0), cxd_t(0.0, 0.0),
+						  cxd_t(0.0, 0.0), cxd_t(1.0, 0.0) };
+		detail::flma<SHUNT>(detail::admittance(RES, z0, 0.0, f), abcd); // termination
+		walk(abcd, f, std::make_index_sequence<size>());
+		return abcd[0] / abcd[2];
+	};
+
+	void input_impedance(const double *f, const std::size_t n, cxd_t *zin) const {
+		for (std::size_t i = 0; i < n; i++) { zin[i] = input_impedance(f[i]); }
+	};
+
+	std::array<double, sizeof...(Slots)> values; // slot values in chain order, length for Trl/Ocs/Scs
+	std::array<double, sizeof...(Slots)> impedances; // characteristic impedance of Trl/Ocs/Scs slots
+	cxd_t z0; // termination
+private:
+	template <std::size_t I>
+	void step(cxd_t *abcd, const double f) const {
+		typedef typename std::tuple_element<I, std::tuple<Slots...> >::type slot_t;
+		const cxd_t v = cxd_t(values[I], 0.0);
+		if constexpr (slot_t::component == TRL) {
+			static_assert(slot_t::mount == SERIES, "no support for shunt TRL");
+			cxd_t m[4];
+			detail::trl_abcd(values[I], impedances[I], 0.0, f, m);
+			detail::flma2(m, abcd);
+		} else if constexpr (slot_t::mount == SHUNT) {
+			detail::flma<SHUNT>(detail::admittance(slot_t::component, v, impedances[I], f), abcd);
+		} else {
+			detail::flma<SERIES>(detail::impedance(slot_t::component, v, impedances[I], f), abcd);
+		}
+	};
+
+	// Last slot first, the comma fold keeps the order
+	template <std::size_t... I>
+	void walk(cxd_t *abcd, const double f, std::index_sequence<I...>) const {
+		(step<size - 1 - I>(abcd, f), ...);
+	};
+};
+
+}
+
+#endif //INCLUDED_CASPORT_STATIC_H
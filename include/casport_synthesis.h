@@ -0,0 +1,61 @@
+#ifndef INCLUDED_CASPORT_SYNTHESIS_H
+#define INCLUDED_CASPORT_SYNTHESIS_H
+
+#include <vector>
+#include "casport.h"
+#include "casport_parallel.h"
+
+namespace casport {
+
+typedef struct synthesis_options {
+	cxd_t z_source;           // the ladder input is matched to conj(z_source)
+	double f_lo;              // band [Hz]
+	double f_hi;
+	std::size_t points;       // of the band grid, one at f_lo when f_hi == f_lo
+	std::size_t max_elements; // of the ladder
+	std::size_t results;      // best networks returned
+	double goal;              // worst |Gamma| good enough, such ladders are not grown further
+	std::size_t iterations;   // of the value optimizer, per candidate
+	double c_min;             // value ranges [F], [H]
+	double c_max;
+	double l_min;
+	double l_max;
+} synthesis_options_t;
+
+inline constexpr synthesis_options_t DEFAULT_SYNTHESIS_OPTIONS = {
+	cxd_t(50.0, 0.0), 1.0e9, 1.0e9, 1, 4, 8, 0.0, 40, 1.0e-14, 1.0e-9, 1.0e-11, 1.0e-6 };
+
+typedef struct match_result {
+	circuit network;      // ladder in front of the load, load elements included
+	std::size_t elements; // of the ladder, network[0..elements)
+	double gamma;         // worst |Gamma| over the band grid
+} match_result_t;
+
+typedef struct synthesis {
+	std::vector<match_result_t> networks; // best first, the shorter ladder of equal ones
+	std::size_t candidates; // ladders whose values were optimized
+	std::size_t pruned;     // leaves skipped by the relaxed refit heuristic
+} synthesis_t;
+
+// Matching ladders of L and C elements in front of load, searched on pool.
+// Ladders grow one element at a time from the load towards the input, each
+// position series or shunt, L or C; adjacent elements of one mount are kept in
+// one order (C then L) as they commute. Every ladder's values are fitted to the
+// band by Levenberg-Marquardt on the log values with circuit::sensitivities for
+// the Jacobian, starting from its parent's values. At the last level, once
+// options.results networks are known, each parent is refitted with the new
+// element relaxed to any reactance of its mount at every band point, and the
+// children on that mount are not optimized when the RMS mismatch left is no
+// better than the current results. The refit is local, from the parent's
+// values, so this is a pruning heuristic rather than a bound: it may skip a
+// child that would have ranked, and shorter ladders are never pruned.
+// Levels run one after the other with their ladders spread over the pool.
+synthesis_t synthesize(thread_pool &pool, const circuit &load,
+	const synthesis_options_t &options = DEFAULT_SYNTHESIS_OPTIONS);
+// Same for a frequency independent load impedance
+synthesis_t synthesize(thread_pool &pool, const cxd_t z_load,
+	const synthesis_options_t &options = DEFAULT_SYNTHESIS_OPTIONS);
+
+}
+
+#endif //INCLUDED_CASPORT_SYNTHESIS_H
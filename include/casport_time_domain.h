@@ -0,0 +1,78 @@
+#ifndef INCLUDED_CASPORT_TIME_DOMAIN_H
+#define INCLUDED_CASPORT_TIME_DOMAIN_H
+
+#include <functional>
+#include <vector>
+#include "casport.h"
+#include "casport_batch.h"
+#include "casport_network.h"
+
+// Time domain responses from sweeps on a uniform grid, low pass mode: the
+// spectrum H(f_k) at f_k = k df, k = 0..points, is windowed, taken as the
+// conjugate symmetric spectrum of a real waveform, zero padded and inverse
+// transformed by a real FFT of samples() points, dt = 1 / (samples() df).
+// Circuits are swept from f_1, H(0) is extrapolated linearly from the real
+// parts at f_1 and f_2.
+namespace casport {
+
+typedef enum window { RECTANGULAR_WINDOW = 0, HANN_WINDOW = 1, KAISER_WINDOW = 2 } window_t;
+typedef enum response { IMPULSE_RESPONSE = 0, STEP_RESPONSE = 1 } response_t;
+
+typedef struct time_domain_options {
+	std::size_t points;  // frequencies above DC
+	double f_max;        // of the last one [Hz]
+	window_t window;     // over [0, f_max], one at DC
+	double beta;         // of the Kaiser window
+	std::size_t samples; // per waveform, rounded up to a power of two of at least 2 (points + 1)
+} time_domain_options_t;
+
+inline constexpr time_domain_options_t DEFAULT_TIME_DOMAIN_OPTIONS = { 1000, 10.0e9, KAISER_WINDOW, 6.0, 0 };
+
+// A transform stage with its grid, window, twiddles and buffers made once and
+// reused by every call, so one instance is not safe to share between threads.
+// Waveforms are periodic over samples() dt, sample j is at t = j dt for
+// j < samples() / 2 and at (j - samples()) dt after. Impulse responses are
+// scaled so a flat H gives a peak of H, step responses are the running sums of
+// the unscaled impulse from t = -samples() / 2 dt and settle at H(0).
+class time_domain {
+public:
+	explicit time_domain(const time_domain_options_t &options = DEFAULT_TIME_DOMAIN_OPTIONS);
+	std::size_t points() const { return m_frequencies.size(); }; // DC included
+	const double *frequencies() const { return m_frequencies.data(); }; // f[points()], f[0] = 0
+	std::size_t samples() const { return m_samples; };
+	double dt() const { return m_dt; };
+	// Waveforms of count spectra h[i*points() + k], emit(i, y) gets waveform i
+	// in y[samples()], valid during the call
+	void transform(const cxd_t *h, const std::size_t count, const response_t response,
+		const std::function<void(const std::size_t i, const double *y)> &emit);
+	void transform(const cxd_t *h, const std::size_t count, const response_t response, double *y); // y[i*samples() + j]
+	// TDR impedance profile of c, z = z_ref (1 + rho) / (1 - rho) with rho the
+	// step response of the input reflection at z_ref, z[samples()]
+	void tdr(const circuit &c, const double z_ref, double *z);
+	// Same for every variant of b, emit(v, z) gets variant v
+	void tdr(const circuit_batch &b, const double z_ref,
+		const std::function<void(const std::size_t v, const double *z)> &emit);
+	// Response of parameter (row major index, 2 is S21) of the two-port of c ahead of its load, y[samples()]
+	void two_port(const circuit &c, const parameters_t to, const std::size_t parameter, const double z_ref,
+		const response_t response, double *y);
+private:
+	void extrapolate_dc(cxd_t *h) const;
+	void inverse(const cxd_t *h, const response_t response, double *y); // one waveform
+	std::vector<double> m_frequencies;
+	std::vector<double> m_window; // points()
+	std::size_t m_samples;
+	double m_dt;
+	double m_impulse_scale;
+	std::vector<cxd_t> m_twiddles;      // of the samples() / 2 complex FFT
+	std::vector<cxd_t> m_spin;          // exp(j 2 pi k / samples()), k < samples() / 2
+	std::vector<std::size_t> m_reverse; // bit reversal permutation
+	std::vector<cxd_t> m_fft;           // work, samples() / 2
+	std::vector<cxd_t> m_spectrum;      // points()
+	std::vector<cxd_t> m_sweep;         // input impedances of batch variants
+	std::vector<double> m_waveform;     // samples()
+	std::vector<double> m_parameters;   // network sweep, re[4] then im[4] planes
+};
+
+}
+
+#endif //INCLUDED_CASPORT_TIME_DOMAIN_H
@@ -0,0 +1,63 @@
+#ifndef INCLUDED_CASPORT_TOUCHSTONE_H
+#define INCLUDED_CASPORT_TOUCHSTONE_H
+
+#include <cstdio>
+#include <string_view>
+#include <vector>
+#include "casport.h"
+
+// Touchstone 1.0 S-parameter files (.s1p, .s2p). The writer formats points
+// with std::to_chars into a fixed buffer that is flushed as it fills, so
+// sweeps of any length stream out in constant memory. The reader parses a
+// memory mapped file in place.
+namespace casport {
+typedef enum tsf { RI = 0, MA = 1, DB = 2 } touchstone_format_t; // re/im, mag/deg, dB/deg
+
+typedef struct touchstone_error {
+	std::size_t line;    // 1 based, 0 on success and for errors not tied to a line
+	const char *message; // static string, nullptr exactly when reading succeeded
+} touchstone_error_t;
+
+// s[k*ports*ports + i*ports + j] is S(i+1)(j+1) at f[k]
+typedef struct touchstone_data {
+	std::size_t ports;
+	double z_ref; // [ohm]
+	std::vector<double> f; // [Hz]
+	std::vector<cxd_t> s;
+} touchstone_data_t;
+
+inline constexpr std::size_t TOUCHSTONE_CHUNK = 16 * SWEEP_BLOCK; // points per circuit sweep when writing
+
+class touchstone_writer {
+public:
+	// Writes the option line, frequencies are written in Hz
+	touchstone_writer(std::FILE *out, const std::size_t ports, const double z_ref = 50.0,
+		const touchstone_format_t format = RI);
+	~touchstone_writer(); // flushes
+	touchstone_writer(const touchstone_writer &) = delete;
+	touchstone_writer &operator=(const touchstone_writer &) = delete;
+	void write(const double *f, const std::size_t n, const cxd_t *s); // s laid out as touchstone_data
+	// Input reflection (one port) or the two-port ahead of the load, swept in
+	// chunks. Writes nothing and fails the writer for more than two ports.
+	void write(const circuit &c, const double *f, const std::size_t n);
+	bool flush(); // false once any write to out, or of a circuit, has failed
+private:
+	void put(const double v);
+	void put(const cxd_t v);
+	void reserve(const std::size_t n);
+	std::FILE *m_out;
+	std::size_t m_ports;
+	double m_z_ref;
+	touchstone_format_t m_format;
+	std::vector<char> m_buffer;
+	std::size_t m_used;
+	bool m_good;
+};
+
+// Ports are taken from the .sNp extension
+touchstone_error_t read_touchstone(const char *path, touchstone_data_t &data);
+touchstone_error_t parse_touchstone(const std::string_view text, const std::size_t ports, touchstone_data_t &data);
+
+}
+
+#endif //INCLUDED_CASPORT_TOUCHSTONE_H
@@ -0,0 +1,39 @@
+#ifndef INCLUDED_CASPORT_TRACE_H
+#define INCLUDED_CASPORT_TRACE_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+// Instrumentation of circuit evaluation. Built in only when CASPORT_TRACE is
+// defined (cmake -DCASPORT_TRACE=ON), otherwise every hook compiles to nothing.
+namespace casport {
+namespace trace {
+
+// Called after each element update of a scalar evaluation, abcd is row major
+typedef void (*sink_t)(void *ctx, const std::size_t step, const std::complex<double> *abcd);
+
+typedef struct counters {
+	std::uint64_t evaluations;     // input impedance points computed
+	std::uint64_t element_updates; // flma applications, one per element and point
+} counters_t;
+
+#ifdef CASPORT_TRACE
+inline constexpr bool enabled = true;
+// nullptr removes the sink. Safe while evaluations run, a sink may still be
+// called by steps already under way when this returns. Replaced bindings are
+// freed by a later call made while no step is running.
+void set_sink(sink_t sink, void *ctx);
+counters_t counters();
+void reset();
+#else
+inline constexpr bool enabled = false;
+inline void set_sink(sink_t, void *) {}
+inline counters_t counters() { return counters_t{0, 0}; }
+inline void reset() {}
+#endif
+
+}
+}
+
+#endif //INCLUDED_CASPORT_TRACE_H
@@ -0,0 +1,163 @@
+#include "../include/casport.h"
+#include <algorithm>
+
+namespace casport{
+
+static inline void
+mul2(cxd_t *r, const cxd_t *x, const cxd_t *y) {
+	r[0] = x[0] * y[0] + x[1] * y[2];
+	r[1] = x[0] * y[1] + x[1] * y[3];
+	r[2] = x[2] * y[0] + x[3] * y[2];
+	r[3] = x[2] * y[1] + x[3] * y[3];
+}
+
+static inline void
+eye2(cxd_t *r) {
+	r[0] = cxd_t(1.0, 0.0);
+	r[1] = cxd_t(0.0, 0.0);
+	r[2] = cxd_t(0.0, 0.0);
+	r[3] = cxd_t(1.0, 0.0);
+}
+
+void
+element_array::reserve(const std::size_t n) {
+	if (m_store.size() < 2 * n) { resize(2 * n); }
+}
+
+// Reallocate with the elements centered, leaving free slots at both ends
+void
+element_array::resize(const std::size_t capacity) {
+	const std::size_t cap = std::max<std::size_t>(capacity, 4);
+	const element filler = empty() ? element(RES, SERIES, 0.0) : front();
+	std::pmr::vector<element> store(cap, filler, m_store.get_allocator());
+	const std::size_t first = (cap - m_size) / 2;
+	std::copy(begin(), end(), store.begin() + first);
+	m_store.swap(store);
+	m_first = first;
+}
+
+void
+element_array::push_back(const element &e) {
+	if (m_first + m_size == m_store.size()) { resize(2 * (m_size + 1)); }
+	m_store[m_first + m_size] = e;
+	m_size++;
+}
+
+void
+element_array::push_front(const element &e) {
+	if (m_first == 0) { resize(2 * (m_size + 1)); }
+	m_first--;
+	m_size++;
+	m_store[m_first] = e;
+}
+
+void
+element_array::insert(const std::size_t i, const element &e) {
+	if (m_first + m_size == m_store.size()) { resize(2 * (m_size + 1)); }
+	std::copy_backward(begin() + i, end(), end() + 1);
+	m_size++;
+	(*this)[i] = e;
+}
+
+void
+element_array::erase(const std::size_t i) {
+	std::copy(begin() + i + 1, end(), begin() + i);
+	m_size--;
+}
+
+abcd_tree::abcd_tree(std::pmr::memory_resource *mr) : m_capacity(0), m_first(0), m_size(0), m_nodes(mr) {
+	resize(4);
+}
+
+abcd_tree::abcd_tree(const abcd_tree &t, std::pmr::memory_resource *mr) :
+	m_capacity(t.m_capacity), m_first(t.m_first), m_size(t.m_size), m_nodes(t.m_nodes, mr) {
+}
+
+void
+abcd_tree::reserve(const std::size_t n) {
+	if (m_capacity < 2 * n) { resize(2 * n); }
+}
+
+// Reallocate with the chain centered, leaving headroom at both ends
+void
+abcd_tree::resize(const std::size_t capacity) {
+	std::size_t cap = 4;
+	while (cap < capacity) { cap *= 2; }
+	std::pmr::vector<mat2> nodes(2 * cap, m_nodes.get_allocator());
+	const std::size_t first = (cap - m_size) / 2;
+	for (std::size_t i = 0; i < cap; i++) { eye2(nodes[cap + i].m); }
+	for (std::size_t i = 0; i < m_size; i++) {
+		nodes[cap + first + i] = m_nodes[m_capacity + m_first + i];
+	}
+	for (std::size_t i = cap - 1; i > 0; i--) {
+		mul2(nodes[i].m, nodes[2*i].m, nodes[2*i + 1].m);
+	}
+	m_nodes.swap(nodes);
+	m_capacity = cap;
+	m_first = first;
+}
+
+// Recompute the products on the path from a leaf to the root
+void
+abcd_tree::pull(std::size_t leaf) {
+	for (std::size_t i = (m_capacity + leaf) / 2; i > 0; i /= 2) {
+		mul2(m_nodes[i].m, m_nodes[2*i].m, m_nodes[2*i + 1].m);
+	}
+}
+
+void
+abcd_tree::assign(const element *elements, const std::size_t n) {
+	// Reuse the nodes when they fit, like a vector the tree does not shrink
+	m_size = 0;
+	if (m_capacity < 2 * n) {
+		resize(2 * n);
+	} else {
+		for (std::size_t i = 0; i < m_capacity; i++) { eye2(m_nodes[m_capacity + i].m); }
+	}
+	m_first = (m_capacity - n) / 2;
+	m_size = n;
+	for (std::size_t i = 0; i < m_size; i++) {
+		elements[i].abcd(m_nodes[m_capacity + m_first + i].m);
+	}
+	for (std::size_t i = m_capacity - 1; i > 0; i--) {
+		mul2(m_nodes[i].m, m_nodes[2*i].m, m_nodes[2*i + 1].m);
+	}
+}
+
+void
+abcd_tree::update(const std::size_t i, const element &e) {
+	e.abcd(m_nodes[m_capacity + m_first + i].m);
+	pull(m_first + i);
+}
+
+void
+abcd_tree::push_front(const element &e) {
+	if (m_first == 0) { resize(2 * (m_size + 1)); }
+	m_first--;
+	m_size++;
+	update(0, e);
+}
+
+void
+abcd_tree::push_back(const element &e) {
+	if (m_first + m_size == m_capacity) { resize(2 * (m_size + 1)); }
+	m_size++;
+	update(m_size - 1, e);
+}
+
+void
+abcd_tree::pop_front() {
+	eye2(m_nodes[m_capacity + m_first].m);
+	pull(m_first);
+	m_first++;
+	m_size--;
+}
+
+void
+abcd_tree::pop_back() {
+	m_size--;
+	eye2(m_nodes[m_capacity + m_first + m_size].m);
+	pull(m_first + m_size);
+}
+
+}
@@ -0,0 +1,299 @@
+#include "../include/casport_adaptive.h"
+#include <algorithm>
+#include <limits>
+
+namespace casport{
+
+// Column major complex matrix
+namespace {
+struct matrix {
+	std::size_t rows;
+	std::size_t cols;
+	std::vector<cxd_t> v;
+	matrix(const std::size_t r, const std::size_t c) : rows(r), cols(c), v(r * c) {};
+	cxd_t &operator()(const std::size_t i, const std::size_t j) { return v[j * rows + i]; };
+	cxd_t operator()(const std::size_t i, const std::size_t j) const { return v[j * rows + i]; };
+};
+}
+
+// Householder QR in place, rows >= cols, leaves R in the upper triangle
+static void
+qr(matrix &a) {
+	for (std::size_t k = 0; k < a.cols; k++) {
+		double norm = 0.0;
+		for (std::size_t i = k; i < a.rows; i++) { norm += std::norm(a(i, k)); }
+		norm = std::sqrt(norm);
+		if (norm == 0.0) { continue; }
+		const cxd_t x0 = a(k, k);
+		const cxd_t alpha = (std::abs(x0) > 0.0) ? -norm * x0 / std::abs(x0) : cxd_t(-norm, 0.0);
+		// v = x - alpha e_k, kept in column k below the diagonal
+		std::vector<cxd_t> v(a.rows - k);
+		v[0] = x0 - alpha;
+		for (std::size_t i = k + 1; i < a.rows; i++) { v[i - k] = a(i, k); }
+		double vv = 0.0;
+		for (const cxd_t &e : v) { vv += std::norm(e); }
+		if (vv == 0.0) { continue; }
+		for (std::size_t j = k; j < a.cols; j++) {
+			cxd_t s = 0.0;
+			for (std::size_t i = k; i < a.rows; i++) { s += std::conj(v[i - k]) * a(i, j); }
+			s *= 2.0 / vv;
+			for (std::size_t i = k; i < a.rows; i++) { a(i, j) -= s * v[i - k]; }
+		}
+	}
+}
+
+// Right singular vector of the smallest singular value of the square upper
+// triangle R of a, by inverse iteration v <- R^-1 R^-H v. The Loewner matrix is
+// close to singular at every step, so a few iterations do.
+static std::vector<cxd_t>
+null_vector(const matrix &a) {
+	const std::size_t m = a.cols;
+	double r_max = 0.0;
+	for (std::size_t j = 0; j < m; j++) { r_max = std::max(r_max, std::abs(a(j, j))); }
+	const double tiny = std::numeric_limits<double>::epsilon() * std::max(r_max, std::numeric_limits<double>::min());
+	std::vector<cxd_t> d(m);
+	for (std::size_t j = 0; j < m; j++) { d[j] = (std::abs(a(j, j)) > tiny) ? a(j, j) : cxd_t(tiny, 0.0); }
+	std::vector<cxd_t> v(m, 1.0 / std::sqrt(static_cast<double>(m))), y(m);
+	for (int it = 0; it < 30; it++) {
+		// R^H y = v, forward
+		for (std::size_t i = 0; i < m; i++) {
+			cxd_t s = v[i];
+			for (std::size_t k = 0; k < i; k++) { s -= std::conj(a(k, i)) * y[k]; }
+			y[i] = s / std::conj(d[i]);
+		}
+		// R x = y, backward, into y
+		for (std::size_t i = m; i-- > 0;) {
+			cxd_t s = y[i];
+			for (std::size_t k = i + 1; k < m; k++) { s -= a(i, k) * y[k]; }
+			y[i] = s / d[i];
+		}
+		double norm = 0.0;
+		for (const cxd_t &e : y) { norm += std::norm(e); }
+		norm = std::sqrt(norm);
+		if (!(norm > 0.0) || !std::isfinite(norm)) { break; }
+		// Converged once v and the new iterate agree up to a phase
+		cxd_t dot = 0.0;
+		for (std::size_t i = 0; i < m; i++) {
+			y[i] /= norm;
+			dot += std::conj(v[i]) * y[i];
+		}
+		v.swap(y);
+		if (1.0 - std::abs(dot) < 1.0e-14) { break; }
+	}
+	return v;
+}
+
+// Barycentric sum at x, exact at the support points
+static cxd_t
+barycentric(const std::vector<double> &xs, const std::vector<cxd_t> &zs, const std::vector<cxd_t> &ws, const double x) {
+	cxd_t num = 0.0, den = 0.0;
+	for (std::size_t k = 0; k < xs.size(); k++) {
+		if (x == xs[k]) { return zs[k]; }
+		const cxd_t c = ws[k] / (x - xs[k]);
+		num += c * zs[k];
+		den += c;
+	}
+	return num / den;
+}
+
+// AAA: support points from the seed, then greedily at the largest residual,
+// each step solving the Loewner least squares problem by QR of its columns
+rational_model
+rational_model::aaa(const double *f, const cxd_t *z, const std::size_t n, const double tol,
+	const std::size_t max_order, const std::vector<double> &seed, std::vector<double> &picked) {
+	rational_model r;
+	picked.clear();
+	if (n == 0) { return r; }
+	const auto span = std::minmax_element(f, f + n);
+	const double center = 0.5 * (*span.first + *span.second);
+	const double scale = (*span.second > *span.first) ? 0.5 * (*span.second - *span.first) : 1.0;
+	std::vector<double> x(n), wt(n);
+	double z_max = 0.0;
+	cxd_t mean = 0.0;
+	for (std::size_t i = 0; i < n; i++) {
+		x[i] = (f[i] - center) / scale;
+		z_max = std::max(z_max, std::abs(z[i]));
+		mean += z[i];
+	}
+	mean /= static_cast<double>(n);
+	const double floor = 1.0e-12 * z_max + std::numeric_limits<double>::min();
+	for (std::size_t i = 0; i < n; i++) { wt[i] = 1.0 / std::max(std::abs(z[i]), floor); }
+
+	std::vector<bool> support(n, false);
+	std::vector<double> xs;
+	std::vector<cxd_t> zs, ws;
+	std::vector<cxd_t> rz(n, mean);
+	std::vector<std::size_t> rows;
+	std::size_t seeded = 0;
+	for (const double s : seed) {
+		const std::size_t j = std::find(f, f + n, s) - f;
+		if (j == n || support[j] || 2 * (seeded + 1) > n || seeded + 1 > max_order) { continue; }
+		support[j] = true;
+		xs.push_back(x[j]);
+		zs.push_back(z[j]);
+		picked.push_back(f[j]);
+		seeded++;
+	}
+	double err = std::numeric_limits<double>::infinity();
+	// Rows must outnumber the unknowns, so at most n/2 support points
+	for (std::size_t m = std::max<std::size_t>(seeded, 1); m <= max_order && 2 * m <= n; m++) {
+		if (m > seeded || seeded == 0) {
+			std::size_t j = 0;
+			double worst = -1.0;
+			for (std::size_t i = 0; i < n; i++) {
+				const double e = support[i] ? -1.0 : wt[i] * std::abs(z[i] - rz[i]);
+				if (e > worst) { worst = e; j = i; }
+			}
+			support[j] = true;
+			xs.push_back(x[j]);
+			zs.push_back(z[j]);
+			picked.push_back(f[j]);
+		}
+
+		rows.clear();
+		for (std::size_t i = 0; i < n; i++) { if (!support[i]) { rows.push_back(i); } }
+		matrix a(rows.size(), m);
+		for (std::size_t k = 0; k < m; k++) {
+			for (std::size_t i = 0; i < rows.size(); i++) {
+				const std::size_t s = rows[i];
+				a(i, k) = wt[s] * (z[s] - zs[k]) / (x[s] - xs[k]);
+			}
+		}
+		qr(a);
+		ws = null_vector(a);
+
+		err = 0.0;
+		for (std::size_t i = 0; i < n; i++) {
+			rz[i] = support[i] ? z[i] : barycentric(xs, zs, ws, x[i]);
+			err = std::max(err, wt[i] * std::abs(z[i] - rz[i]));
+		}
+		if (err <= tol) { break; }
+	}
+	r.m_center = center;
+	r.m_scale = scale;
+	r.m_support = xs;
+	r.m_values = zs;
+	r.m_weights = ws;
+	r.m_error = err;
+	r.m_converged = err <= tol;
+	return r;
+}
+
+rational_model
+rational_model::fit(const double *f, const cxd_t *z, const std::size_t n, const double tol,
+	const std::size_t max_order) {
+	std::vector<double> picked;
+	return aaa(f, z, n, tol, max_order, std::vector<double>(), picked);
+}
+
+cxd_t
+rational_model::operator()(const double f) const {
+	if (m_support.empty()) { return cxd_t(std::nan(""), std::nan("")); }
+	return barycentric(m_support, m_values, m_weights, (f - m_center) / m_scale);
+}
+
+void
+rational_model::evaluate(const double *f, const std::size_t n, cxd_t *z) const {
+	for (std::size_t i = 0; i < n; i++) { z[i] = (*this)(f[i]); }
+}
+
+rational_model
+adaptive_sweep(const circuit &c, const double f_lo, const double f_hi, const adaptive_options_t &options) {
+	// Samples kept sorted by frequency, each new batch of checks is one sweep
+	std::vector<double> f;
+	std::vector<cxd_t> z;
+	if (!(f_hi > f_lo)) {
+		// No interval to refine, the constant at f_lo
+		rational_model r;
+		r.m_center = f_lo;
+		r.m_scale = 1.0;
+		r.m_support.assign(1, 0.0);
+		r.m_values.resize(1);
+		r.m_weights.assign(1, cxd_t(1.0, 0.0));
+		c.input_impedance(&f_lo, 1, r.m_values.data(), DOUBLE_PRECISION);
+		r.m_evaluations = 1;
+		r.m_error = 0.0;
+		r.m_converged = (f_hi == f_lo);
+		return r;
+	}
+	const std::size_t initial = std::max<std::size_t>(3, std::min(options.initial, options.max_points));
+	for (std::size_t i = 0; i < initial; i++) {
+		f.push_back(f_lo + (f_hi - f_lo) * static_cast<double>(i) / static_cast<double>(initial - 1));
+	}
+	z.resize(f.size());
+	c.input_impedance(f.data(), f.size(), z.data(), DOUBLE_PRECISION);
+
+	// Intervals [f[i], f[i+1]) still to check, by their left end
+	std::vector<double> open(f.begin(), f.end() - 1);
+	const double fit_tol = 0.1 * options.tol; // at the samples, well below the check tolerance
+	const double min_width = 1.0e-9 * (f_hi - f_lo);
+	// Every refit starts from the support points of the previous one
+	std::vector<double> seed, picked;
+	rational_model r = rational_model::aaa(f.data(), z.data(), f.size(), fit_tol, options.max_order, seed, picked);
+	double error = 0.0;
+	std::vector<double> check, left, next;
+	std::vector<cxd_t> zc;
+	while (!open.empty() && f.size() < options.max_points) {
+		check.clear();
+		left.clear();
+		next.clear();
+		std::size_t o = 0;
+		for (; o < open.size() && f.size() + check.size() < options.max_points; o++) {
+			const double a = open[o];
+			const std::size_t i = std::lower_bound(f.begin(), f.end(), a) - f.begin();
+			const double b = f[i + 1];
+			if (b - a < min_width) { continue; } // resolution limit, taken as passed
+			check.push_back(0.5 * (a + b));
+			left.push_back(a);
+		}
+		next.assign(open.begin() + o, open.end()); // left for lack of points
+		if (check.empty()) {
+			open.swap(next);
+			break;
+		}
+		zc.resize(check.size());
+		c.input_impedance(check.data(), check.size(), zc.data(), DOUBLE_PRECISION);
+
+		error = 0.0;
+		for (std::size_t i = 0; i < check.size(); i++) {
+			const double e = std::abs(r(check[i]) - zc[i]) / std::max(std::abs(zc[i]), std::numeric_limits<double>::min());
+			error = std::max(error, e);
+			if (e > options.tol) {
+				next.push_back(left[i]);
+				next.push_back(check[i]);
+			}
+		}
+		// Merge the checks into the samples
+		std::vector<double> fm(f.size() + check.size());
+		std::vector<cxd_t> zm(fm.size());
+		std::size_t p = 0, q = 0;
+		for (std::size_t k = 0; k < fm.size(); k++) {
+			if (q == check.size() || (p < f.size() && f[p] < check[q])) {
+				fm[k] = f[p]; zm[k] = z[p]; p++;
+			} else {
+				fm[k] = check[q]; zm[k] = zc[q]; q++;
+			}
+		}
+		std::sort(next.begin(), next.end());
+		f.swap(fm);
+		z.swap(zm);
+		open.swap(next);
+		seed.swap(picked);
+		r = rational_model::aaa(f.data(), z.data(), f.size(), fit_tol, options.max_order, seed, picked);
+	}
+	r.m_evaluations = f.size();
+	r.m_error = error;
+	r.m_converged = open.empty();
+	return r;
+}
+
+rational_model
+adaptive_sweep(const circuit &c, const double *f, const std::size_t n, cxd_t *zin, const adaptive_options_t &options) {
+	if (n == 0) { return rational_model(); }
+	const auto span = std::minmax_element(f, f + n);
+	const rational_model r = adaptive_sweep(c, *span.first, *span.second, options);
+	r.evaluate(f, n, zin);
+	return r;
+}
+
+}
@@ -0,0 +1,161 @@
+#include "../include/casport_batch.h"
+#include "device.h"
+#include "kernels.h"
+#include <algorithm>
+
+namespace casport{
+
+circuit_batch::circuit_batch(const circuit &topology, const std::size_t variants) :
+	m_topology(topology), m_variants(variants), m_values(topology.size() * variants),
+	m_imag(topology.size() * variants), m_revision(1), m_backend(AUTO_BACKEND) {
+	for (std::size_t i = 0; i < size(); i++) {
+		std::fill_n(values(i), m_variants, std::real(m_topology[i].value()));
+		if (m_topology[i].is_line() || m_topology[i].is_stub()) { continue; }
+		std::fill_n(imag_values(i), m_variants, std::imag(m_topology[i].value()));
+	}
+}
+
+// Chain product of up to SWEEP_BLOCK variants at f, lane j is variant first + j
+void
+circuit_batch::block(const double f, const std::size_t first, const std::size_t count, abcd_soa &abcd) const {
+	alignas(64) double x_re[SWEEP_BLOCK], x_im[SWEEP_BLOCK];
+	alignas(64) double t[SWEEP_BLOCK], c[SWEEP_BLOCK], s[SWEEP_BLOCK];
+	const double w = 2.0 * M_PI * f;
+	const double beta = detail::phase_per_hz(1.0) * f; // [rad/m]
+	abcd.identity(count);
+	for (std::size_t i = size(); i-- > 0;) {
+		const element &e = m_topology[i];
+		const double *v = values(i) + first, *u = imag_values(i) + first;
+		const bool shunt = (e.mount() == SHUNT);
+		const double z0 = e.z0();
+		if (e.is_line() || e.is_stub()) {
+			for (std::size_t j = 0; j < count; j++) { t[j] = beta * v[j]; }
+			kernels::sincos(t, s, c, count);
+		}
+		switch (e.component()) {
+		case TRL:
+			if (e.alpha() == 0.0) {
+				kernels::cline(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, c, s, 1.0, 0.0, z0, count);
+				kernels::cline(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, c, s, 1.0, 0.0, z0, count);
+			} else {
+				// Loss varies with the length, build the matrix per lane
+				alignas(64) double p_re[SWEEP_BLOCK], p_im[SWEEP_BLOCK], q_re[SWEEP_BLOCK], q_im[SWEEP_BLOCK];
+				for (std::size_t j = 0; j < count; j++) {
+					const double ch = std::cosh(e.alpha() * v[j]), sh = std::sinh(e.alpha() * v[j]);
+					p_re[j] = ch * c[j]; p_im[j] = sh * s[j];
+					x_re[j] = sh * c[j]; x_im[j] = ch * s[j];
+					q_re[j] = z0 * x_re[j]; q_im[j] = z0 * x_im[j];
+					x_re[j] /= z0; x_im[j] /= z0;
+				}
+				kernels::crotv(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, p_re, p_im, q_re, q_im, x_re, x_im, p_re, p_im, count);
+				kernels::crotv(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, p_re, p_im, q_re, q_im, x_re, x_im, p_re, p_im, count);
+			}
+			continue;
+		case SUB:
+			// Nothing varies, the block matrix at f in every lane
+			e.flma(abcd, f, v, count);
+			continue;
+		// Lumped values v + j u, the real formulas where u = 0
+		case RES:
+			for (std::size_t j = 0; j < count; j++) {
+				if (u[j] == 0.0) {
+					x_re[j] = shunt ? 1.0 / v[j] : v[j]; x_im[j] = 0.0;
+				} else {
+					const double r = shunt ? 1.0 / (v[j] * v[j] + u[j] * u[j]) : 1.0;
+					x_re[j] = r * v[j]; x_im[j] = shunt ? -r * u[j] : u[j];
+				}
+			}
+			break;
+		case CAP:
+			for (std::size_t j = 0; j < count; j++) {
+				if (u[j] == 0.0) {
+					x_re[j] = 0.0; x_im[j] = shunt ? w * v[j] : -1.0 / (w * v[j]);
+				} else if (shunt) {
+					x_re[j] = -w * u[j]; x_im[j] = w * v[j];
+				} else {
+					const double r = 1.0 / (w * (v[j] * v[j] + u[j] * u[j]));
+					x_re[j] = -r * u[j]; x_im[j] = -r * v[j];
+				}
+			}
+			break;
+		case IND:
+			for (std::size_t j = 0; j < count; j++) {
+				if (u[j] == 0.0) {
+					x_re[j] = 0.0; x_im[j] = shunt ? -1.0 / (w * v[j]) : w * v[j];
+				} else if (shunt) {
+					const double r = 1.0 / (w * (v[j] * v[j] + u[j] * u[j]));
+					x_re[j] = -r * u[j]; x_im[j] = -r * v[j];
+				} else {
+					x_re[j] = -w * u[j]; x_im[j] = w * v[j];
+				}
+			}
+			break;
+		case OCS:
+			for (std::size_t j = 0; j < count; j++) { x_re[j] = 0.0; x_im[j] = shunt ? s[j] / (z0 * c[j]) : -z0 * c[j] / s[j]; }
+			break;
+		case SCS:
+			for (std::size_t j = 0; j < count; j++) { x_re[j] = 0.0; x_im[j] = shunt ? -c[j] / (z0 * s[j]) : z0 * s[j] / c[j]; }
+			break;
+		}
+		e.flma(abcd, x_re, x_im, count);
+	}
+}
+
+void
+circuit_batch::sweep(const double *f, const std::size_t n, const std::size_t first,
+	const std::size_t count, cxd_t *zin) const {
+	abcd_soa abcd;
+	alignas(64) double x_re[SWEEP_BLOCK], x_im[SWEEP_BLOCK];
+	for (std::size_t b = 0; b < count; b += SWEEP_BLOCK) {
+		const std::size_t m = std::min(SWEEP_BLOCK, count - b);
+		for (std::size_t k = 0; k < n; k++) {
+			block(f[k], first + b, m, abcd);
+			kernels::cdiv(x_re, x_im, abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, m);
+			for (std::size_t j = 0; j < m; j++) {
+				zin[(b + j) * n + k] = cxd_t(x_re[j], x_im[j]);
+			}
+		}
+	}
+}
+
+// Sends the values first if they changed since the last device sweep
+bool
+circuit_batch::device_sweep(const double *f, const std::size_t n, const std::size_t first,
+	const std::size_t count, cxd_t *zin) const {
+	std::lock_guard<std::mutex> guard(m_device.m_lock);
+	if (m_device.m_tables == nullptr && (m_device.m_tables = device::create(m_topology)) == nullptr) {
+		return false;
+	}
+	if (m_device.m_revision != m_revision) {
+		m_device.m_revision = 0;
+		// Real values only, as monte_carlo::device_run
+		if (std::any_of(m_imag.begin(), m_imag.end(), [](const double u) { return u != 0.0; })) { return false; }
+		if (!device::set_values(m_device.m_tables, m_values.data(), m_variants)) { return false; }
+		m_device.m_revision = m_revision;
+	}
+	return device::input_impedance(m_device.m_tables, f, n, first, count, zin);
+}
+
+void
+circuit_batch::input_impedance(const double *f, const std::size_t n, const std::size_t first,
+	const std::size_t count, cxd_t *zin) const {
+	if (device::use(m_backend, count * n) && device_sweep(f, n, first, count, zin)) { return; }
+	sweep(f, n, first, count, zin);
+}
+
+void
+circuit_batch::input_impedance(const double *f, const std::size_t n, cxd_t *zin) const {
+	input_impedance(f, n, 0, m_variants, zin);
+}
+
+void
+circuit_batch::input_impedance(thread_pool &pool, const double *f, const std::size_t n, cxd_t *zin) const {
+	if (device::use(m_backend, m_variants * n) && device_sweep(f, n, 0, m_variants, zin)) { return; }
+	const std::size_t tasks = (m_variants + SWEEP_CHUNK - 1) / SWEEP_CHUNK;
+	pool.parallel_for(tasks, [&](std::size_t task) {
+		const std::size_t v = task * SWEEP_CHUNK;
+		sweep(f, n, v, std::min(SWEEP_CHUNK, m_variants - v), zin + v * n);
+	});
+}
+
+}
@@ -1,178 +1,812 @@
 #include "../include/casport.h"
+#include "kernels.h"
+#include "trace.h"
+#include <algorithm>
+#include <type_traits>
 
 namespace casport{
 
-element::element(const casport::element_t e, const mount_t m, const cxd_t v) {
-	if (m == SHUNT) {
-		m_mount = m;
-		switch (e) {
-		case TRL:
-			// No support for shunt TRL
-			break;
-		case CAP:
-			break;
-		case IND:
-			break;
-		case RES:
-			m_component = RES;
-			m_admittance = 1.0/v;
-			m_impedance = v;
-			m_abcd[0] = cxd_t(1.0, 0.0);
-			m_abcd[1] = v;
-			m_abcd[2] = cxd_t(0.0, 0.0);
-			break;
-		case OCS:
-			break;
-		case SCS:
-			break;		
-			}
-	} else {
-		switch (e) {
-		case TRL:
-			// No support for shunt TRL
-			break;
-		case CAP:
-			break;
-		case IND:
-			break;
-		case RES:
-			break;
-		case OCS:
-			break;
-		case SCS:
-			break;		
-			}		
-	}
-}
-
-element::element(const casport::element_t e, const mount_t m, const double v) {
-		m_mount = m;
+// Lines are two-ports in the chain, always SERIES whatever m says
+element::element(const casport::element_t e, const mount_t m, const cxd_t v) :
+	m_component(e), m_mount((e == TRL) ? SERIES : m), m_value(v),
+	m_z0((e == TRL || e == OCS || e == SCS) ? DEFAULT_Z0 : 0.0), m_alpha(0.0), m_frequency(DEFAULT_FREQUENCY),
+	m_block(nullptr) {
+	update();
+}
+
+// Recompute the cached immittances and matrix from component, mount and value
+void
+element::update() {
+	const element_t e = m_component;
+	const cxd_t v = m_value;
+	m_impedance = cxd_t(0.0, 0.0);
+	m_admittance = cxd_t(0.0, 0.0);
+	m_abcd[0] = cxd_t(1.0, 0.0);
+	m_abcd[1] = cxd_t(0.0, 0.0);
+	m_abcd[2] = cxd_t(0.0, 0.0);
+	m_abcd[3] = cxd_t(1.0, 0.0);
+	if (e == TRL) {
+		detail::trl_abcd(std::real(v), m_z0, m_alpha, m_frequency, m_abcd);
+		return;
+	}
+	if (e == SUB) {
+		m_block->abcd(m_frequency, m_abcd);
+		return;
+	}
+	m_impedance = detail::impedance(e, v, m_z0, m_frequency);
+	m_admittance = detail::admittance(e, v, m_z0, m_frequency);
 	if (m_mount == SHUNT) {
-		switch (e) {
-		case TRL:
-			// No support for shunt TRL
-			break;
-		case CAP:
-			break;
-		case IND:
-			break;
-		case RES:
-			m_component = RES;
-			m_admittance = 1.0/v;
-			m_impedance = v;
-			m_abcd[0] = cxd_t(1.0, 0.0);
-			m_abcd[1] = cxd_t(0.0, 0.0);
-			m_abcd[2] = m_admittance;
-			break;
-		case OCS:
-			break;
-		case SCS:
-			break;		
-			}
+		m_abcd[2] = m_admittance;
 	} else if (m_mount == SERIES) {
-		switch (e) {
-		case TRL:
-			// No support for shunt TRL
-			break;
-		case CAP:
-			break;
-		case IND:
-			break;
-		case RES:
-			m_component = RES;
-			m_admittance = 1.0/v;
-			m_impedance = v;
-			m_abcd[0] = cxd_t(1.0, 0.0);
-			m_abcd[1] = m_impedance;
-			m_abcd[2] = cxd_t(0.0, 0.0);		
-			break;
-		case OCS:
-			break;
-		case SCS:
-			break;		
-			}		
+		m_abcd[1] = m_impedance;
 	}
 }
 
-element::element(const double l, const double z0) {
+void
+element::set_value(const cxd_t v) {
+	m_value = v;
+	update();
+}
 
+element::element(const casport::element_t e, const mount_t m, const double v) :
+	element(e, m, cxd_t(v, 0.0)) {
 }
 
+element::element(const casport::element_t e, const mount_t m, const double l, const double z0) :
+	m_component(e), m_mount((e == TRL) ? SERIES : m), m_value(cxd_t(l, 0.0)), m_z0(z0), m_alpha(0.0),
+	m_frequency(DEFAULT_FREQUENCY), m_block(nullptr) {
+	update();
+}
 
-element::~element(){
+element::element(const double l, const double z0) : element(l, z0, 0.0) {
+}
+
+element::element(const subcircuit &block) :
+	m_component(SUB), m_mount(SERIES), m_value(cxd_t(0.0, 0.0)), m_z0(0.0), m_alpha(0.0),
+	m_frequency(DEFAULT_FREQUENCY), m_block(&block) {
+	update();
+}
+
+element::element(const double l, const double z0, const double alpha) :
+	m_component(TRL), m_mount(SERIES), m_value(cxd_t(l, 0.0)), m_z0(z0), m_alpha(alpha),
+	m_frequency(DEFAULT_FREQUENCY), m_block(nullptr) {
+	update();
 }
 
 void
-element::flma(cxd_t *abcd) {
+element::set_frequency(const double f) {
+	if (f == m_frequency) { return; }
+	m_frequency = f;
+	if (!is_constant()) { update(); }
+}
+
+static_assert(std::is_trivially_copyable<element>::value, "element is kept by value in flat arrays");
+
+cxd_t
+element::immittance(const double f) const {
+	if (is_constant() || f == m_frequency) {
+		return (m_mount == SHUNT) ? m_admittance : m_impedance;
+	}
+	return (m_mount == SHUNT) ? detail::admittance(m_component, m_value, m_z0, f) :
+		detail::impedance(m_component, m_value, m_z0, f);
+}
+
+// Immittance with the element value multiplied by scale
+cxd_t
+element::immittance(const double f, const double scale) const {
+	if (is_constant()) {
+		return (m_mount == SHUNT) ? m_admittance / scale : m_impedance * scale;
+	}
+	return (m_mount == SHUNT) ? detail::admittance(m_component, m_value * scale, m_z0, f) :
+		detail::impedance(m_component, m_value * scale, m_z0, f);
+}
+
+void
+element::abcd(cxd_t *m) const {
+	m[0] = m_abcd[0];
+	m[1] = m_abcd[1];
+	m[2] = m_abcd[2];
+	m[3] = m_abcd[3];
+}
+
+void
+element::abcd(const double f, cxd_t *m) const {
+	if (is_block()) {
+		m_block->abcd(f, m);
+		return;
+	}
+	if (is_line()) {
+		detail::trl_abcd(std::real(m_value), m_z0, m_alpha, f, m);
+		return;
+	}
+	m[0] = m[3] = cxd_t(1.0, 0.0);
+	m[1] = m[2] = cxd_t(0.0, 0.0);
+	m[(m_mount == SHUNT) ? 2 : 1] = immittance(f);
+}
+
+void
+element::dabcd(cxd_t *dm) const {
+	dm[0] = dm[1] = dm[2] = dm[3] = cxd_t(0.0, 0.0);
+	if (is_block()) { return; } // no value
+	if (is_line()) {
+		// dT/dl = gamma [sinh, z0 cosh; cosh/z0, sinh](gamma l)
+		const double l = std::real(m_value);
+		const double theta = detail::phase_per_hz(l) * m_frequency;
+		const double c = std::cos(theta), s = std::sin(theta);
+		const double ch = std::cosh(m_alpha * l), sh = std::sinh(m_alpha * l);
+		const cxd_t gamma = cxd_t(m_alpha, detail::phase_per_hz(1.0) * m_frequency);
+		const cxd_t cg = cxd_t(ch * c, sh * s), sg = cxd_t(sh * c, ch * s);
+		dm[0] = gamma * sg;
+		dm[1] = gamma * m_z0 * cg;
+		dm[2] = gamma * cg / m_z0;
+		dm[3] = gamma * sg;
+		return;
+	}
+	// Derivative of the immittance with respect to the value
+	double beta = 0.0, sec2 = 0.0, csc2 = 0.0;
+	if (is_stub()) {
+		beta = detail::phase_per_hz(1.0) * m_frequency; // [rad/m]
+		const double t = beta * std::real(m_value);
+		sec2 = 1.0 / (std::cos(t) * std::cos(t));
+		csc2 = 1.0 / (std::sin(t) * std::sin(t));
+	}
+	cxd_t dx = cxd_t(0.0, 0.0);
+	switch (m_component) {
+	case RES:
+		dx = (m_mount == SHUNT) ? -m_admittance * m_admittance : cxd_t(1.0, 0.0);
+		break;
+	case CAP:
+		dx = (m_mount == SHUNT) ? m_admittance / m_value : -m_impedance / m_value;
+		break;
+	case IND:
+		dx = (m_mount == SHUNT) ? -m_admittance / m_value : m_impedance / m_value;
+		break;
+	case OCS:
+		dx = (m_mount == SHUNT) ? cxd_t(0.0, beta * sec2 / m_z0) : cxd_t(0.0, m_z0 * beta * csc2);
+		break;
+	case SCS:
+		dx = (m_mount == SHUNT) ? cxd_t(0.0, beta * csc2 / m_z0) : cxd_t(0.0, m_z0 * beta * sec2);
+		break;
+	case TRL:
+	case SUB:
+		break;
+	}
+	dm[(m_mount == SHUNT) ? 2 : 1] = dx;
+}
+
+// Left multiply abcd by the element matrix, i.e. a row update
+void
+element::flma(cxd_t *abcd) const {
+	if (is_two_port()) {
+		cxd_t m[4];
+		this->abcd(m);
+		detail::flma2(m, abcd);
+	} else if (m_mount == SHUNT) {
+		detail::flma<SHUNT>(m_admittance, abcd);
+	} else if (m_mount == SERIES){
+		detail::flma<SERIES>(m_impedance, abcd);
+	}
+}
+
+void
+element::immittance(const double *f, const std::size_t n, double *x_re, double *x_im) const {
+	alignas(64) double f_rec[SWEEP_BLOCK], c[SWEEP_BLOCK], s[SWEEP_BLOCK];
+	for (std::size_t k = 0; k < n; k += SWEEP_BLOCK) {
+		const std::size_t m = std::min(SWEEP_BLOCK, n - k);
+		for (std::size_t i = 0; i < m; i++) { f_rec[i] = 1.0 / f[k + i]; }
+		if (is_stub()) {
+			const double p = detail::phase_per_hz(std::real(m_value));
+			for (std::size_t i = 0; i < m; i++) { x_re[k + i] = p * f[k + i]; }
+			kernels::sincos(x_re + k, s, c, m);
+		}
+		immittance(f + k, f_rec, c, s, m, x_re + k, x_im + k);
+	}
+}
+
+// Fill x with the immittance over a block, streaming the shared sweep tables
+template<typename T>
+void
+element::immittance(const double *f, const T *f_rec, const T *cos_t, const T *sin_t,
+	const std::size_t n, T *x_re, T *x_im) const {
+	const bool shunt = (m_mount == SHUNT);
+	cxd_t k; // x = k * f or k / f
+	switch (m_component) {
+	case RES:
+		std::fill(x_re, x_re + n, static_cast<T>(std::real(immittance(0.0))));
+		std::fill(x_im, x_im + n, static_cast<T>(std::imag(immittance(0.0))));
+		return;
+	case CAP:
+	case IND:
+		if ((m_component == CAP) == shunt) {
+			k = cxd_t(0.0, 2.0 * M_PI) * m_value; // jwC or jwL
+			for (std::size_t i = 0; i < n; i++) {
+				x_re[i] = static_cast<T>(std::real(k) * f[i]);
+				x_im[i] = static_cast<T>(std::imag(k) * f[i]);
+			}
+		} else {
+			k = 1.0 / (cxd_t(0.0, 2.0 * M_PI) * m_value); // 1/(jwC) or 1/(jwL)
+			const T k_re = static_cast<T>(std::real(k)), k_im = static_cast<T>(std::imag(k));
+			for (std::size_t i = 0; i < n; i++) {
+				x_re[i] = k_re * f_rec[i];
+				x_im[i] = k_im * f_rec[i];
+			}
+		}
+		return;
+	case OCS:
+	case SCS:
+		// Open: Z = -j z0 cot, Y = j tan/z0, short: Z = j z0 tan, Y = -j cot/z0
+		if ((m_component == SCS) != shunt) {
+			const T g = static_cast<T>(shunt ? 1.0 / m_z0 : m_z0);
+			for (std::size_t i = 0; i < n; i++) {
+				x_re[i] = T(0);
+				x_im[i] = g * sin_t[i] / cos_t[i];
+			}
+		} else {
+			const T g = static_cast<T>(shunt ? -1.0 / m_z0 : -m_z0);
+			for (std::size_t i = 0; i < n; i++) {
+				x_re[i] = T(0);
+				x_im[i] = g * cos_t[i] / sin_t[i];
+			}
+		}
+		return;
+	case TRL:
+	case SUB:
+		break;
+	}
+	std::fill(x_re, x_re + n, T(0));
+	std::fill(x_im, x_im + n, T(0));
+}
+
+// Vectorized row update over the lanes of abcd, x[i] is the immittance of lane i
+template<typename A, typename T>
+void
+element::flma(abcd_soa_t<A> &abcd, const T *x_re, const T *x_im, const std::size_t n) const {
 	if (m_mount == SHUNT) {
-		abcd[2] += m_admittance * abcd[0];
-		abcd[3] += m_admittance * abcd[1];
+		kernels::cfma(abcd.c_re, abcd.c_im, abcd.a_re, abcd.a_im, x_re, x_im, n);
+		kernels::cfma(abcd.d_re, abcd.d_im, abcd.b_re, abcd.b_im, x_re, x_im, n);
 	} else if (m_mount == SERIES){
-		abcd[0] += m_impedance * abcd[1];
-		abcd[1] += m_impedance * abcd[3];
+		kernels::cfma(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, x_re, x_im, n);
+		kernels::cfma(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, x_re, x_im, n);
+	}
+}
+
+// Same immittance x in every lane
+template<typename A>
+void
+element::flma(abcd_soa_t<A> &abcd, const cxd_t x, const std::size_t n) const {
+	const A x_re = static_cast<A>(std::real(x)), x_im = static_cast<A>(std::imag(x));
+	if (m_mount == SHUNT) {
+		kernels::cfma(abcd.c_re, abcd.c_im, abcd.a_re, abcd.a_im, x_re, x_im, n);
+		kernels::cfma(abcd.d_re, abcd.d_im, abcd.b_re, abcd.b_im, x_re, x_im, n);
+	} else if (m_mount == SERIES){
+		kernels::cfma(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, x_re, x_im, n);
+		kernels::cfma(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, x_re, x_im, n);
+	}
+}
+
+template<typename A, typename T>
+void
+element::flma_trl(abcd_soa_t<A> &abcd, const T *cos_t, const T *sin_t, const std::size_t n) const {
+	const double l = std::real(m_value);
+	const A ch = static_cast<A>(std::cosh(m_alpha * l)), sh = static_cast<A>(std::sinh(m_alpha * l));
+	const A z0 = static_cast<A>(m_z0);
+	kernels::cline(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, cos_t, sin_t, ch, sh, z0, n);
+	kernels::cline(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, cos_t, sin_t, ch, sh, z0, n);
+}
+
+template<typename A>
+void
+element::flma_two_port(abcd_soa_t<A> &abcd, const double *const *m, const std::size_t n) const {
+	if constexpr (std::is_same<A, double>::value) {
+		kernels::crotv(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], n);
+		kernels::crotv(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], n);
+	} else {
+		A *x_re[2] = { abcd.a_re, abcd.b_re }, *x_im[2] = { abcd.a_im, abcd.b_im };
+		A *y_re[2] = { abcd.c_re, abcd.d_re }, *y_im[2] = { abcd.c_im, abcd.d_im };
+		for (std::size_t j = 0; j < 2; j++) {
+			for (std::size_t i = 0; i < n; i++) {
+				const std::complex<A> x(x_re[j][i], x_im[j][i]), y(y_re[j][i], y_im[j][i]);
+				const std::complex<A> p(A(m[0][i]), A(m[1][i])), q(A(m[2][i]), A(m[3][i]));
+				const std::complex<A> r(A(m[4][i]), A(m[5][i])), s(A(m[6][i]), A(m[7][i]));
+				const std::complex<A> u = p * x + q * y, v = r * x + s * y;
+				x_re[j][i] = u.real(); x_im[j][i] = u.imag();
+				y_re[j][i] = v.real(); y_im[j][i] = v.imag();
+			}
+		}
+	}
+}
+
+// Double sweeps, and float tables with float (single) or double (mixed) lanes
+template void element::immittance<double>(const double *, const double *, const double *, const double *,
+	const std::size_t, double *, double *) const;
+template void element::immittance<float>(const double *, const float *, const float *, const float *,
+	const std::size_t, float *, float *) const;
+template void element::flma<double, double>(abcd_soa_t<double> &, const double *, const double *, const std::size_t) const;
+template void element::flma<float, float>(abcd_soa_t<float> &, const float *, const float *, const std::size_t) const;
+template void element::flma<double, float>(abcd_soa_t<double> &, const float *, const float *, const std::size_t) const;
+template void element::flma<double>(abcd_soa_t<double> &, const cxd_t, const std::size_t) const;
+template void element::flma<float>(abcd_soa_t<float> &, const cxd_t, const std::size_t) const;
+template void element::flma_trl<double, double>(abcd_soa_t<double> &, const double *, const double *, const std::size_t) const;
+template void element::flma_trl<float, float>(abcd_soa_t<float> &, const float *, const float *, const std::size_t) const;
+template void element::flma_trl<double, float>(abcd_soa_t<double> &, const float *, const float *, const std::size_t) const;
+template void element::flma_two_port<double>(abcd_soa_t<double> &, const double *const *, const std::size_t) const;
+template void element::flma_two_port<float>(abcd_soa_t<float> &, const double *const *, const std::size_t) const;
+
+// Every lane at f, lane i with the value scaled by scale[i]
+void
+element::flma(abcd_soa &abcd, const double f, const double *scale, const std::size_t n) const {
+	alignas(64) double x_re[SWEEP_BLOCK], x_im[SWEEP_BLOCK];
+	if (is_block()) {
+		// No value to scale, the same matrix in every lane
+		cxd_t m[4];
+		this->abcd(f, m);
+		kernels::crot(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, reinterpret_cast<const double *>(m), n);
+		kernels::crot(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, reinterpret_cast<const double *>(m), n);
+		return;
 	}
+	if (is_line()) {
+		alignas(64) double p_re[SWEEP_BLOCK], p_im[SWEEP_BLOCK], q_re[SWEEP_BLOCK], q_im[SWEEP_BLOCK];
+		alignas(64) double r_re[SWEEP_BLOCK], r_im[SWEEP_BLOCK];
+		cxd_t m[4];
+		for (std::size_t i = 0; i < n; i++) {
+			detail::trl_abcd(std::real(m_value) * scale[i], m_z0, m_alpha, f, m);
+			p_re[i] = std::real(m[0]); p_im[i] = std::imag(m[0]);
+			q_re[i] = std::real(m[1]); q_im[i] = std::imag(m[1]);
+			r_re[i] = std::real(m[2]); r_im[i] = std::imag(m[2]);
+		}
+		kernels::crotv(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, p_re, p_im, q_re, q_im, r_re, r_im, p_re, p_im, n);
+		kernels::crotv(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, p_re, p_im, q_re, q_im, r_re, r_im, p_re, p_im, n);
+		return;
+	}
+	for (std::size_t i = 0; i < n; i++) {
+		const cxd_t x = immittance(f, scale[i]);
+		x_re[i] = std::real(x);
+		x_im[i] = std::imag(x);
+	}
+	flma(abcd, x_re, x_im, n);
+}
+
+// Lane i at frequency f[i]
+void
+element::flma(abcd_soa &abcd, const double *f, const std::size_t n) const {
+	if (is_block()) {
+		abcd_soa t;
+		m_block->abcd(f, n, t);
+		const double *m[8] = { t.a_re, t.a_im, t.b_re, t.b_im, t.c_re, t.c_im, t.d_re, t.d_im };
+		flma_two_port(abcd, m, n);
+	} else if (is_line()) {
+		alignas(64) double t[SWEEP_BLOCK], c[SWEEP_BLOCK], s[SWEEP_BLOCK];
+		const double k = detail::phase_per_hz(std::real(m_value));
+		for (std::size_t i = 0; i < n; i++) { t[i] = k * f[i]; }
+		kernels::sincos(t, s, c, n);
+		flma_trl(abcd, c, s, n);
+	} else if (is_constant()) {
+		flma(abcd, immittance(0.0), n);
+	} else {
+		alignas(64) double x_re[SWEEP_BLOCK], x_im[SWEEP_BLOCK];
+		immittance(f, n, x_re, x_im);
+		flma(abcd, x_re, x_im, n);
+	}
+}
+
+
+
+circuit::circuit() : circuit(50.0) {
 }
 
+circuit::circuit(const cxd_t z0) : circuit(z0, std::pmr::get_default_resource()) {
+}
+
+circuit::circuit(const double z0) : circuit(cxd_t(z0, 0.0), std::pmr::get_default_resource()) {
+}
 
+circuit::circuit(const double z0, std::pmr::memory_resource *mr) : circuit(cxd_t(z0, 0.0), mr) {
+}
 
-circuit::circuit() {
-	m_z0 = cxd_t(50.0, 0.0);
-	std::shared_ptr<element> e_ptr = std::make_shared<element>(RES, SHUNT, m_z0);
-	m_elements.push_back( std::move(e_ptr) );
-	std::cout << "new circuit with Z0:" << m_z0 << std::endl;
+circuit::circuit(const cxd_t z0, std::pmr::memory_resource *mr) :
+	m_z0(z0), m_elements(mr), m_tree(mr), m_front(0), m_frequency(DEFAULT_FREQUENCY), m_revision(1) {
+	m_elements.reserve(4);
+	m_elements.push_back( element(RES, SHUNT, z0) );
+	m_tree.assign(m_elements.begin(), m_elements.size());
 }
 
-circuit::circuit(const cxd_t z0) : m_z0(z0) {
-	std::shared_ptr<element> e_ptr = std::make_shared<element>(RES, SHUNT, z0);
-	m_elements.push_back( std::move(e_ptr) );
-	std::cout << "new circuit with Z0:" << m_z0 << std::endl;
+circuit::circuit(const cxd_t z0, const element *chain, const std::size_t n, std::pmr::memory_resource *mr) :
+	m_z0(z0), m_elements(mr), m_tree(mr), m_front(0), m_frequency(DEFAULT_FREQUENCY), m_revision(1) {
+	m_elements.reserve(n + 1);
+	for (std::size_t i = 0; i < n; i++) {
+		m_elements.push_back( chain[i] );
+		m_elements.back().set_frequency( m_frequency );
+	}
+	m_elements.push_back( element(RES, SHUNT, z0) );
+	m_tree.assign(m_elements.begin(), m_elements.size());
 }
 
-circuit::circuit(const double z0) : m_z0(cxd_t(z0, 0.0)) {
-	std::shared_ptr<element> e_ptr = std::make_shared<element>(RES, SHUNT, z0);
-	m_elements.push_back( std::move(e_ptr) );
-	std::cout << "new circuit with Z0:" << m_z0 << std::endl;
+circuit::circuit(const circuit &c, std::pmr::memory_resource *mr) :
+	m_z0(c.m_z0), m_elements(c.m_elements, mr), m_tree(c.m_tree, mr), m_front(c.m_front),
+	m_frequency(c.m_frequency), m_revision(c.m_revision) {
 }
 
 circuit::~circuit() {
 }
 
-#include <cstdio>
-void print4(cxd_t *a){
-	printf("\n(%6.2f, %6.2f)", std::real(*a), std::imag(*a));
-	a++;
-	printf("\t(%6.2f, %6.2f)\n", std::real(*a), std::imag(*a));
-	a++;
-	printf("(%6.2f, %6.2f)", std::real(*a), std::imag(*a));
-	a++;
-	printf("\t(%6.2f, %6.2f)\n", std::real(*a), std::imag(*a));
-	a++;	
+void
+circuit::reserve(const std::size_t n) {
+	m_elements.reserve(n);
+	m_tree.reserve(n);
 }
 
+// Full chain walk, used when a trace sink wants every step
 cxd_t
-circuit::input_impedance() {
+circuit::walk() const {
 	if (m_elements.empty()) { return cxd_t(std::nan(""), std::nan("") ); }
 
 	cxd_t abcd[4] = { cxd_t(1.0, 0.0), cxd_t(0.0, 0.0), 
 					  cxd_t(0.0, 0.0), cxd_t(1.0, 0.0) }; // row major storage
 
-    std::vector<std::shared_ptr<element>>::reverse_iterator e_ptr = m_elements.rbegin();
-    while (e_ptr != m_elements.rend()) {
-    	(*e_ptr)->flma( abcd );
+    std::size_t step = 0;
+    auto e_ptr = m_elements.crbegin();
+    while (e_ptr != m_elements.crend()) {
+    	e_ptr->flma( abcd );
         e_ptr++;
-    	print4(abcd);
+    	CASPORT_TRACE_STEP(step++, abcd);
     }
-	return 1.0 / abcd[2];
+    CASPORT_TRACE_COUNT(1, m_elements.size());
+	return abcd[0] / abcd[2];
 }
 
-void 
-circuit::push_back(std::shared_ptr<element> e_ptr){
-	m_elements.push_back( std::move(e_ptr) ); //Own this pointer
+cxd_t
+circuit::input_impedance() const {
+	if (m_elements.empty()) { return cxd_t(std::nan(""), std::nan("") ); }
+#ifdef CASPORT_TRACE
+	if (trace::has_sink()) { return walk(); }
+#endif
+	CASPORT_TRACE_COUNT(1, 0);
+	const cxd_t *abcd = m_tree.product();
+	return abcd[0] / abcd[2];
+}
+
+void
+circuit::input_impedance(const double *f, const std::size_t n, cxd_t *zin) const {
+	if (m_memo.recall(m_revision, f, n, zin)) { return; }
+	sweep(f, n, zin);
+	m_memo.store(m_revision, f, n, zin);
 }
 
-void 
-circuit::push_front(std::shared_ptr<element> e_ptr){
-	m_elements.insert( m_elements.begin(), std::move(e_ptr) ); //Own this pointer
+// Scale every lane to a largest entry of one. Long float chains leave the float
+// range otherwise, the ratios (input impedance) are unchanged.
+static void
+normalize(abcd_soa_t<float> &abcd, const std::size_t n) {
+	for (std::size_t i = 0; i < n; i++) {
+		const float s = std::max(std::max(std::max(std::fabs(abcd.a_re[i]), std::fabs(abcd.a_im[i])),
+			std::max(std::fabs(abcd.b_re[i]), std::fabs(abcd.b_im[i]))),
+			std::max(std::max(std::fabs(abcd.c_re[i]), std::fabs(abcd.c_im[i])),
+			std::max(std::fabs(abcd.d_re[i]), std::fabs(abcd.d_im[i]))));
+		const float r = (s > 0.0f) ? 1.0f / s : 1.0f;
+		abcd.a_re[i] *= r; abcd.a_im[i] *= r;
+		abcd.b_re[i] *= r; abcd.b_im[i] *= r;
+		abcd.c_re[i] *= r; abcd.c_im[i] *= r;
+		abcd.d_re[i] *= r; abcd.d_im[i] *= r;
+	}
+}
+
+static constexpr std::size_t NORMALIZE_EVERY = 8; // float chain elements between rescales
+
+// Product of elements [0, n_el) for every block of up to SWEEP_BLOCK points,
+// emit(k, m, abcd) gets lanes f[k..k+m). Tables (1/f, sincos, immittances)
+// are kept as T and the chain is accumulated as A. Float chains are scaled as
+// they go, so only ratios of their entries are meaningful.
+template<typename T, typename A>
+void
+circuit::chain(const double *f, const std::size_t n, const std::size_t n_el,
+	const std::function<void(const std::size_t k, const std::size_t m, const abcd_soa_t<A> &abcd)> &emit) const {
+	// Lines and stubs of equal length have the same phase whatever their z0 or
+	// loss, so each distinct length gets one sincos table per block
+	std::vector<double> lengths;
+	std::vector<std::size_t> slot(n_el);
+	for (std::size_t i = 0; i < n_el; i++) {
+		if (!m_elements[i].is_line() && !m_elements[i].is_stub()) { continue; }
+		const double l = std::real(m_elements[i].value());
+		slot[i] = std::find(lengths.begin(), lengths.end(), l) - lengths.begin();
+		if (slot[i] == lengths.size()) { lengths.push_back(l); }
+	}
+	std::vector<T> trig(2 * lengths.size() * SWEEP_BLOCK); // cos then sin per length
+	// Subcircuits are swept over the whole grid once, their instances share the table
+	std::vector<subcircuit::table_t> tables(n_el);
+	for (std::size_t i = 0; i < n_el; i++) {
+		if (!m_elements[i].is_block()) { continue; }
+		std::size_t j = 0;
+		while (j < i && m_elements[j].block() != m_elements[i].block()) { j++; }
+		tables[i] = (j < i) ? tables[j] : m_elements[i].block()->sweep(f, n);
+	}
+
+	abcd_soa_t<A> abcd;
+	alignas(64) double theta[SWEEP_BLOCK];
+	alignas(64) T z_re[SWEEP_BLOCK], z_im[SWEEP_BLOCK];
+	alignas(64) T f_rec[SWEEP_BLOCK];
+	for (std::size_t k = 0; k < n; k += SWEEP_BLOCK) {
+		const std::size_t m = std::min(SWEEP_BLOCK, n - k);
+		for (std::size_t i = 0; i < m; i++) { f_rec[i] = static_cast<T>(1.0 / f[k + i]); }
+		for (std::size_t j = 0; j < lengths.size(); j++) {
+			const double p = detail::phase_per_hz(lengths[j]);
+			for (std::size_t i = 0; i < m; i++) { theta[i] = p * f[k + i]; }
+			T *c = trig.data() + 2 * j * SWEEP_BLOCK;
+			kernels::sincos(theta, c + SWEEP_BLOCK, c, m);
+		}
+		abcd.identity(m);
+		// One walk of the chain per block of frequencies
+		for (std::size_t i = n_el; i-- > 0;) {
+			const element &e = m_elements[i];
+			if (e.is_block()) {
+				const double *t = tables[i]->data() + k;
+				const double *r[8] = { t, t + n, t + 2 * n, t + 3 * n, t + 4 * n, t + 5 * n, t + 6 * n, t + 7 * n };
+				e.flma_two_port(abcd, r, m);
+			} else if (e.is_line()) {
+				const T *c = trig.data() + 2 * slot[i] * SWEEP_BLOCK;
+				e.flma_trl(abcd, c, c + SWEEP_BLOCK, m);
+			} else if (e.is_constant()) {
+				e.flma(abcd, e.immittance(0.0), m);
+			} else {
+				const T *c = e.is_stub() ? trig.data() + 2 * slot[i] * SWEEP_BLOCK : f_rec;
+				e.immittance(f + k, f_rec, c, c + SWEEP_BLOCK, m, z_re, z_im);
+				e.flma(abcd, z_re, z_im, m);
+			}
+			if constexpr (std::is_same<A, float>::value) {
+				if (i > 0 && i % NORMALIZE_EVERY == 0) { normalize(abcd, m); }
+			}
+		}
+		CASPORT_TRACE_COUNT(m, m * n_el);
+		emit(k, m, abcd);
+	}
+}
+
+void
+circuit::sweep(const double *f, const std::size_t n, cxd_t *zin) const {
+	if (m_elements.empty()) {
+		for (std::size_t i = 0; i < n; i++) { zin[i] = cxd_t(std::nan(""), std::nan("")); }
+		return;
+	}
+	alignas(64) double z_re[SWEEP_BLOCK], z_im[SWEEP_BLOCK];
+	chain<double, double>(f, n, m_elements.size(), [&](const std::size_t k, const std::size_t m, const abcd_soa &abcd) {
+		kernels::cdiv(z_re, z_im, abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, m);
+		for (std::size_t i = 0; i < m; i++) {
+			zin[k + i] = cxd_t(z_re[i], z_im[i]);
+		}
+	});
+}
+
+void
+circuit::input_impedance(const double *f, const std::size_t n, cxd_t *zin, const precision_t precision) const {
+	if (precision == DOUBLE_PRECISION || m_elements.empty()) {
+		sweep(f, n, zin);
+	} else if (precision == SINGLE_PRECISION) {
+		alignas(64) float z_re[SWEEP_BLOCK], z_im[SWEEP_BLOCK];
+		chain<float, float>(f, n, m_elements.size(), [&](const std::size_t k, const std::size_t m, const abcd_soa_t<float> &abcd) {
+			kernels::cdiv(z_re, z_im, abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, m);
+			for (std::size_t i = 0; i < m; i++) {
+				zin[k + i] = cxd_t(z_re[i], z_im[i]);
+			}
+		});
+	} else {
+		alignas(64) double z_re[SWEEP_BLOCK], z_im[SWEEP_BLOCK];
+		chain<float, double>(f, n, m_elements.size(), [&](const std::size_t k, const std::size_t m, const abcd_soa &abcd) {
+			kernels::cdiv(z_re, z_im, abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, m);
+			for (std::size_t i = 0; i < m; i++) {
+				zin[k + i] = cxd_t(z_re[i], z_im[i]);
+			}
+		});
+	}
+}
+
+void
+circuit::abcd(const double *f, const std::size_t n, cxd_t *abcd) const {
+	const std::size_t n_el = m_elements.empty() ? 0 : m_elements.size() - 1;
+	chain<double, double>(f, n, n_el, [&](const std::size_t k, const std::size_t m, const abcd_soa &p) {
+		for (std::size_t i = 0; i < m; i++) {
+			cxd_t *r = abcd + 4 * (k + i);
+			r[0] = cxd_t(p.a_re[i], p.a_im[i]);
+			r[1] = cxd_t(p.b_re[i], p.b_im[i]);
+			r[2] = cxd_t(p.c_re[i], p.c_im[i]);
+			r[3] = cxd_t(p.d_re[i], p.d_im[i]);
+		}
+	});
+}
+
+void
+circuit::abcd(const double *f, const std::size_t n, const network_soa_t &abcd) const {
+	const std::size_t n_el = m_elements.empty() ? 0 : m_elements.size() - 1;
+	chain<double, double>(f, n, n_el, [&](const std::size_t k, const std::size_t m, const abcd_soa &p) {
+		const double *re[4] = { p.a_re, p.b_re, p.c_re, p.d_re };
+		const double *im[4] = { p.a_im, p.b_im, p.c_im, p.d_im };
+		for (std::size_t j = 0; j < 4; j++) {
+			std::copy(re[j], re[j] + m, abcd.re[j] + k);
+			std::copy(im[j], im[j] + m, abcd.im[j] + k);
+		}
+	});
+}
+
+// With M = P[i] E[i] S[i], dM = P[i] dE[i] S[i]. Only the first column of each
+// suffix product is needed for A and C, so one backward pass stores S[i][:,0]
+// and one forward pass carries the prefix product, O(n) in total.
+void
+circuit::sensitivities(cxd_t *grad) const {
+	const std::size_t n = m_elements.size();
+	if (n == 0) { return; }
+	std::vector<cxd_t> s(2 * n);
+	cxd_t v0 = cxd_t(1.0, 0.0), v1 = cxd_t(0.0, 0.0);
+	cxd_t m[4];
+	for (std::size_t i = n; i-- > 0;) {
+		s[2*i + 0] = v0;
+		s[2*i + 1] = v1;
+		m_elements[i].abcd(m);
+		const cxd_t w0 = m[0] * v0 + m[1] * v1;
+		const cxd_t w1 = m[2] * v0 + m[3] * v1;
+		v0 = w0;
+		v1 = w1;
+	}
+	const cxd_t a = v0, c = v1; // first column of the full product
+	cxd_t p[4] = { cxd_t(1.0, 0.0), cxd_t(0.0, 0.0), cxd_t(0.0, 0.0), cxd_t(1.0, 0.0) };
+	cxd_t dm[4];
+	for (std::size_t i = 0; i < n; i++) {
+		m_elements[i].dabcd(dm);
+		const cxd_t u0 = dm[0] * s[2*i] + dm[1] * s[2*i + 1]; // dE S[:,0]
+		const cxd_t u1 = dm[2] * s[2*i] + dm[3] * s[2*i + 1];
+		const cxd_t da = p[0] * u0 + p[1] * u1;
+		const cxd_t dc = p[2] * u0 + p[3] * u1;
+		grad[i] = (da * c - a * dc) / (c * c);
+		m_elements[i].abcd(m);
+		const cxd_t q[4] = { p[0] * m[0] + p[1] * m[2], p[0] * m[1] + p[1] * m[3],
+							 p[2] * m[0] + p[3] * m[2], p[2] * m[1] + p[3] * m[3] };
+		std::copy(q, q + 4, p);
+	}
+}
+
+std::vector<cxd_t>
+circuit::sensitivities() const {
+	std::vector<cxd_t> grad(m_elements.size());
+	sensitivities(grad.data());
+	return grad;
+}
+
+element_handle_t
+circuit::push_back(const element &e){
+	m_elements.push_back( e );
+	m_elements.back().set_frequency( m_frequency );
+	m_tree.push_back( m_elements.back() );
+	m_revision++;
+	return handle( m_elements.size() - 1 );
+}
+
+element_handle_t
+circuit::push_front(const element &e){
+	m_elements.push_front( e );
+	m_elements.front().set_frequency( m_frequency );
+	m_tree.push_front( m_elements.front() );
+	m_revision++;
+	m_front--;
+	return handle( 0 );
+}
+
+void
+circuit::pop_back(){
+	if (m_elements.empty()) { return; }
+	m_elements.pop_back();
+	m_tree.pop_back();
+	m_revision++;
+}
+
+void
+circuit::pop_front(){
+	if (m_elements.empty()) { return; }
+	m_elements.pop_front();
+	m_tree.pop_front();
+	m_revision++;
+	m_front++;
+}
+
+element_handle_t
+circuit::insert(const std::size_t i, const element &e){
+	if (i == 0) { return push_front(e); }
+	if (i >= m_elements.size()) { return push_back(e); }
+	m_elements.insert( i, e );
+	m_elements[i].set_frequency( m_frequency );
+	m_tree.assign( m_elements.begin(), m_elements.size() );
+	m_revision++;
+	return handle( i );
+}
+
+void
+circuit::erase(const std::size_t i){
+	if (i >= m_elements.size()) { return; }
+	if (i == 0) { pop_front(); return; }
+	if (i == m_elements.size() - 1) { pop_back(); return; }
+	m_elements.erase( i );
+	m_tree.assign( m_elements.begin(), m_elements.size() );
+	m_revision++;
+}
+
+void
+circuit::replace(const std::size_t i, const element &e){
+	if (i >= m_elements.size()) { return; }
+	m_elements[i] = e;
+	m_elements[i].set_frequency( m_frequency );
+	m_tree.update( i, m_elements[i] );
+	m_revision++;
+}
+
+void
+circuit::set_frequency(const double f){
+	if (f == m_frequency) { return; }
+	m_frequency = f;
+	for (auto &e : m_elements) { e.set_frequency( f ); }
+	m_tree.assign( m_elements.begin(), m_elements.size() );
+	m_revision++;
+}
+
+// Recomputes one element in place and the O(log n) path of the product tree
+void
+circuit::set_value(const element_handle_t h, const cxd_t v){
+	const std::size_t i = index( h );
+	if (i >= m_elements.size()) { return; }
+	m_elements[i].set_value( v );
+	m_tree.update( i, m_elements[i] );
+	m_revision++;
+}
+
+subcircuit::subcircuit(const circuit &c) : m_circuit(c) {
+}
+
+void
+subcircuit::abcd(const double f, cxd_t *m) const {
+	m_circuit.abcd(&f, 1, m);
+}
+
+void
+subcircuit::abcd(const double *f, const std::size_t n, abcd_soa &m) const {
+	const network_soa_t r = { { m.a_re, m.b_re, m.c_re, m.d_re }, { m.a_im, m.b_im, m.c_im, m.d_im } };
+	m_circuit.abcd(f, n, r);
+}
+
+// Sweeps running on another grid keep the table they got, a new table replaces
+// the kept one
+subcircuit::table_t
+subcircuit::sweep(const double *f, const std::size_t n) const {
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (m_table && m_f.size() == n && std::equal(m_f.begin(), m_f.end(), f)) { return m_table; }
+	}
+	std::shared_ptr<std::vector<double>> t = std::make_shared<std::vector<double>>(8 * n);
+	double *p = t->data();
+	const network_soa_t r = { { p, p + 2 * n, p + 4 * n, p + 6 * n }, { p + n, p + 3 * n, p + 5 * n, p + 7 * n } };
+	m_circuit.abcd(f, n, r);
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_f.assign(f, f + n);
+	m_table = t;
+	return t;
+}
+
+bool
+sweep_memo::recall(const std::uint64_t revision, const double *f, const std::size_t n, cxd_t *zin) const {
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_revision != revision || m_f.size() != n) { return false; }
+	if (!std::equal(m_f.begin(), m_f.end(), f)) { return false; }
+	std::copy(m_zin.begin(), m_zin.end(), zin);
+	return true;
+}
+
+void
+sweep_memo::store(const std::uint64_t revision, const double *f, const std::size_t n, const cxd_t *zin) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_revision = revision;
+	m_f.assign(f, f + n);
+	m_zin.assign(zin, zin + n);
+}
+
+void
+sweep_memo::clear() {
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_revision = 0;
+	m_f.clear();
+	m_zin.clear();
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "device.h"
+
+namespace casport{
+
+bool
+backend_available(const backend_t b) {
+	return (b != CUDA_BACKEND) || device::available();
+}
+
+void
+device_cache::clear() {
+	std::lock_guard<std::mutex> guard(m_lock);
+	device::destroy(m_tables);
+	m_tables = nullptr;
+	m_revision = 0;
+}
+
+namespace device {
+
+bool
+use(const backend_t b, const std::size_t points) {
+	switch (b) {
+	case CPU_BACKEND:
+		return false;
+	case CUDA_BACKEND:
+		return available();
+	case AUTO_BACKEND:
+		break;
+	}
+	return (points >= DEVICE_MIN_POINTS) && available();
+}
+
+#ifndef CASPORT_CUDA
+// Built without a device backend
+bool available() { return false; }
+tables *create(const circuit &) { return nullptr; }
+void destroy(tables *) {}
+bool set_values(tables *, const double *, const std::size_t) { return false; }
+bool set_tolerances(tables *, const tolerance_t *, const std::uint64_t) { return false; }
+bool input_impedance(tables *, const double *, const std::size_t, const std::uint64_t,
+	const std::size_t, cxd_t *) { return false; }
+#endif
+
+}
+}
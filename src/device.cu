@@ -0,0 +1,253 @@
+// CUDA backend of circuit_batch and monte_carlo sweeps, one thread per
+// (variant, frequency) point walking the chain from the load to the input.
+// Only the first column of the chain product is needed for Zin = A/C, so a
+// thread carries two complex numbers instead of a 2x2 matrix.
+#include "device.h"
+#include "random.h"
+#include <cuda_runtime.h>
+#include <algorithm>
+#include <vector>
+
+namespace casport {
+namespace device {
+
+namespace {
+// Element of the chain as the kernel sees it
+struct step {
+	int component;
+	int shunt;
+	double z0;
+	double alpha;
+	double value; // nominal, real part
+};
+
+constexpr unsigned THREADS = 128; // per block
+
+__device__ inline double2 operator+(const double2 x, const double2 y) { return make_double2(x.x + y.x, x.y + y.y); }
+__device__ inline double2 operator*(const double s, const double2 x) { return make_double2(s * x.x, s * x.y); }
+__device__ inline double2 operator*(const double2 x, const double2 y) {
+	return make_double2(x.x * y.x - x.y * y.y, x.x * y.y + x.y * y.x);
+}
+__device__ inline double2
+operator/(const double2 x, const double2 y) {
+	const double den = 1.0 / (y.x * y.x + y.y * y.y);
+	return make_double2((x.x * y.x + x.y * y.y) * den, (x.y * y.x - x.x * y.y) * den);
+}
+
+// Zin of one point, value(i) is the value of element i in this variant
+template<typename V>
+__device__ double2
+point(const step *steps, const std::size_t n_el, const V &value, const double f, const double beta_per_hz) {
+	const double w = 2.0 * M_PI * f;
+	const double beta = beta_per_hz * f; // [rad/m]
+	double2 a = make_double2(1.0, 0.0), c = make_double2(0.0, 0.0);
+	for (std::size_t i = n_el; i-- > 0;) {
+		const step e = steps[i];
+		const double v = value(i);
+		double s = 0.0, cs = 1.0;
+		if (e.component == TRL || e.component == OCS || e.component == SCS) {
+			sincos(beta * v, &s, &cs);
+		}
+		double2 x = make_double2(0.0, 0.0);
+		switch (e.component) {
+		case TRL: {
+			const double ch = cosh(e.alpha * v), sh = sinh(e.alpha * v);
+			const double2 cg = make_double2(ch * cs, sh * s), sg = make_double2(sh * cs, ch * s);
+			const double2 na = cg * a + e.z0 * (sg * c);
+			c = (1.0 / e.z0) * (sg * a) + cg * c;
+			a = na;
+			}
+			continue;
+		case RES:
+			x.x = e.shunt ? 1.0 / v : v;
+			break;
+		case CAP:
+			x.y = e.shunt ? w * v : -1.0 / (w * v);
+			break;
+		case IND:
+			x.y = e.shunt ? -1.0 / (w * v) : w * v;
+			break;
+		case OCS:
+			x.y = e.shunt ? s / (e.z0 * cs) : -e.z0 * cs / s;
+			break;
+		case SCS:
+			x.y = e.shunt ? -cs / (e.z0 * s) : e.z0 * s / cs;
+			break;
+		}
+		if (e.shunt) {
+			c = c + x * a;
+		} else {
+			a = a + x * c;
+		}
+	}
+	return a / c;
+}
+
+struct batch_value {
+	const double *values;
+	std::size_t variants;
+	std::size_t v;
+	__device__ double operator()(const std::size_t i) const { return values[i * variants + v]; }
+};
+
+struct trial_value {
+	const step *steps;
+	const tolerance_t *tolerances;
+	std::uint64_t seed;
+	std::uint64_t trial;
+	__device__ double operator()(const std::size_t i) const {
+		const tolerance_t t = tolerances[i];
+		return (t.dist == FIXED) ? steps[i].value : steps[i].value * random::scale(t, seed, i, trial);
+	}
+};
+
+// Thread t is point (first + t / n, t % n), so a warp shares a variant and
+// writes contiguous zin
+__global__ void
+batch_kernel(const step *steps, const std::size_t n_el, const double *values, const std::size_t variants,
+	const double *f, const std::size_t n, const std::size_t first, const std::size_t count,
+	const double beta_per_hz, double2 *zin) {
+	const std::size_t t = std::size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+	if (t >= count * n) { return; }
+	const std::size_t k = t % n;
+	const batch_value value{ values, variants, first + t / n };
+	zin[t] = point(steps, n_el, value, f[k], beta_per_hz);
+}
+
+__global__ void
+trial_kernel(const step *steps, const std::size_t n_el, const tolerance_t *tolerances, const std::uint64_t seed,
+	const double *f, const std::size_t n, const std::uint64_t first, const std::size_t count,
+	const double beta_per_hz, double2 *zin) {
+	const std::size_t t = std::size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+	if (t >= count * n) { return; }
+	const std::size_t k = t % n;
+	const trial_value value{ steps, tolerances, seed, first + t / n };
+	zin[t] = point(steps, n_el, value, f[k], beta_per_hz);
+}
+
+// Grows a device buffer to at least n elements, contents are not kept
+template<typename T>
+bool
+reserve(T *&p, std::size_t &capacity, const std::size_t n) {
+	if (n <= capacity) { return true; }
+	cudaFree(p);
+	p = nullptr;
+	capacity = 0;
+	if (cudaMalloc(reinterpret_cast<void **>(&p), n * sizeof(T)) != cudaSuccess) { return false; }
+	capacity = n;
+	return true;
+}
+}
+
+struct tables {
+	std::size_t size; // elements
+	step *steps;
+	double *values; // set_values, size x variants
+	std::size_t variants;
+	std::size_t values_capacity;
+	tolerance_t *tolerances; // set_tolerances, size
+	std::uint64_t seed;
+	bool trials; // tolerances were set last
+	double *f;
+	std::size_t f_capacity;
+	double2 *zin; // one launch of points
+	std::size_t zin_capacity;
+};
+
+bool
+available() {
+	static const bool present = [] {
+		int n = 0;
+		return (cudaGetDeviceCount(&n) == cudaSuccess) && (n > 0);
+	}();
+	return present;
+}
+
+tables *
+create(const circuit &topology) {
+	if (!available()) { return nullptr; }
+	std::vector<step> steps(topology.size());
+	for (std::size_t i = 0; i < topology.size(); i++) {
+		const element &e = topology[i];
+		if (e.is_block()) { return nullptr; } // subcircuits stay on the CPU
+		steps[i] = step{ e.component(), e.is_shunt(), e.z0(), e.alpha(), std::real(e.value()) };
+	}
+	tables *t = new tables{ steps.size(), nullptr, nullptr, 0, 0, nullptr, 0, false, nullptr, 0, nullptr, 0 };
+	if (cudaMalloc(reinterpret_cast<void **>(&t->steps), steps.size() * sizeof(step)) != cudaSuccess ||
+		cudaMemcpy(t->steps, steps.data(), steps.size() * sizeof(step), cudaMemcpyHostToDevice) != cudaSuccess) {
+		destroy(t);
+		return nullptr;
+	}
+	return t;
+}
+
+void
+destroy(tables *t) {
+	if (t == nullptr) { return; }
+	cudaFree(t->steps);
+	cudaFree(t->values);
+	cudaFree(t->tolerances);
+	cudaFree(t->f);
+	cudaFree(t->zin);
+	delete t;
+}
+
+bool
+set_values(tables *t, const double *values, const std::size_t variants) {
+	const std::size_t n = t->size * variants;
+	if (!reserve(t->values, t->values_capacity, n) ||
+		cudaMemcpy(t->values, values, n * sizeof(double), cudaMemcpyHostToDevice) != cudaSuccess) {
+		return false;
+	}
+	t->variants = variants;
+	t->trials = false;
+	return true;
+}
+
+bool
+set_tolerances(tables *t, const tolerance_t *tol, const std::uint64_t seed) {
+	if (t->tolerances == nullptr &&
+		cudaMalloc(reinterpret_cast<void **>(&t->tolerances), t->size * sizeof(tolerance_t)) != cudaSuccess) {
+		return false;
+	}
+	if (cudaMemcpy(t->tolerances, tol, t->size * sizeof(tolerance_t), cudaMemcpyHostToDevice) != cudaSuccess) {
+		return false;
+	}
+	t->seed = seed;
+	t->trials = true;
+	return true;
+}
+
+// Variants are sent in launches of about DEVICE_CHUNK_POINTS points, each copied
+// back straight into its rows of zin
+bool
+input_impedance(tables *t, const double *f, const std::size_t n, const std::uint64_t first,
+	const std::size_t count, cxd_t *zin) {
+	if (n == 0 || count == 0) { return true; }
+	const std::size_t rows = std::max<std::size_t>(1, DEVICE_CHUNK_POINTS / n);
+	if (!reserve(t->f, t->f_capacity, n) || !reserve(t->zin, t->zin_capacity, std::min(rows, count) * n) ||
+		cudaMemcpy(t->f, f, n * sizeof(double), cudaMemcpyHostToDevice) != cudaSuccess) {
+		return false;
+	}
+	const double beta_per_hz = detail::phase_per_hz(1.0);
+	for (std::size_t v = 0; v < count; v += rows) {
+		const std::size_t m = std::min(rows, count - v);
+		const unsigned blocks = static_cast<unsigned>((m * n + THREADS - 1) / THREADS);
+		if (t->trials) {
+			trial_kernel<<<blocks, THREADS>>>(t->steps, t->size, t->tolerances, t->seed, t->f, n,
+				first + v, m, beta_per_hz, t->zin);
+		} else {
+			batch_kernel<<<blocks, THREADS>>>(t->steps, t->size, t->values, t->variants, t->f, n,
+				first + v, m, beta_per_hz, t->zin);
+		}
+		// cxd_t and double2 are both two packed doubles
+		if (cudaGetLastError() != cudaSuccess ||
+			cudaMemcpy(zin + v * n, t->zin, m * n * sizeof(double2), cudaMemcpyDeviceToHost) != cudaSuccess) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+}
@@ -0,0 +1,30 @@
+#ifndef INCLUDED_CASPORT_SRC_DEVICE_H
+#define INCLUDED_CASPORT_SRC_DEVICE_H
+
+#include "../include/casport_device.h"
+#include "../include/casport_montecarlo.h"
+
+// GPU side of circuit_batch and monte_carlo sweeps. device.cu implements it when
+// the library is built with CASPORT_CUDA, otherwise there is never a device and
+// every call fails, leaving the caller on its CPU path.
+namespace casport {
+namespace device {
+
+bool available();
+bool use(const backend_t b, const std::size_t points); // run a sweep of points on the device
+// Topology of the chain, element kinds, mounts, z0, alpha and nominal values.
+// nullptr without a device or device memory.
+tables *create(const circuit &topology);
+void destroy(tables *t);
+// Per variant element values, values[i*variants + v]
+bool set_values(tables *t, const double *values, const std::size_t variants);
+// Monte Carlo trials instead, element i of trial t is nominal * random::scale(tol[i], seed, i, t)
+bool set_tolerances(tables *t, const tolerance_t *tol, const std::uint64_t seed);
+// zin[v*n + k] for variants (trials) [first, first + count) at f[k]
+bool input_impedance(tables *t, const double *f, const std::size_t n, const std::uint64_t first,
+	const std::size_t count, cxd_t *zin);
+
+}
+}
+
+#endif //INCLUDED_CASPORT_SRC_DEVICE_H
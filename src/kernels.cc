@@ -0,0 +1,148 @@
+#include "kernels.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace casport {
+namespace kernels {
+
+namespace generic { extern const table TABLE; }
+#ifdef CASPORT_KERNELS_X86
+namespace avx2 { extern const table TABLE; }
+namespace avx512 { extern const table TABLE; }
+#endif
+
+namespace {
+
+// Variants the CPU can run, best first
+std::size_t
+supported(const table **v) {
+	std::size_t n = 0;
+#ifdef CASPORT_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+		__builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512bw"))
+		v[n++] = &avx512::TABLE;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		v[n++] = &avx2::TABLE;
+#endif
+	v[n++] = &generic::TABLE;
+	return n;
+}
+
+const table *
+select() {
+	const table *v[3];
+	const std::size_t n = supported(v);
+	// An unknown or unsupported CASPORT_ISA falls back to the best variant
+	if (const char *want = std::getenv("CASPORT_ISA"))
+		for (std::size_t i = 0; i < n; i++)
+			if (std::strcmp(want, v[i]->name) == 0)
+				return v[i];
+	return v[0];
+}
+
+const table &
+active() {
+	static const table *const t = select();
+	return *t;
+}
+
+}
+
+void
+cfma(double *x_re, double *x_im, const double *y_re, const double *y_im,
+	const double *z_re, const double *z_im, const std::size_t n) {
+	active().cfma_v(x_re, x_im, y_re, y_im, z_re, z_im, n);
+}
+
+void
+cfma(double *x_re, double *x_im, const double *y_re, const double *y_im,
+	const double z_re, const double z_im, const std::size_t n) {
+	active().cfma_b(x_re, x_im, y_re, y_im, z_re, z_im, n);
+}
+
+void
+crot(double *x_re, double *x_im, double *y_re, double *y_im, const double *m, const std::size_t n) {
+	active().crot(x_re, x_im, y_re, y_im, m, n);
+}
+
+void
+crotv(double *x_re, double *x_im, double *y_re, double *y_im,
+	const double *p_re, const double *p_im, const double *q_re, const double *q_im,
+	const double *r_re, const double *r_im, const double *s_re, const double *s_im, const std::size_t n) {
+	active().crotv(x_re, x_im, y_re, y_im, p_re, p_im, q_re, q_im, r_re, r_im, s_re, s_im, n);
+}
+
+void
+cline(double *x_re, double *x_im, double *y_re, double *y_im,
+	const double *c, const double *s, const double ch, const double sh, const double z0,
+	const std::size_t n) {
+	active().cline(x_re, x_im, y_re, y_im, c, s, ch, sh, z0, n);
+}
+
+void
+sincos(const double *x, double *s, double *c, const std::size_t n) {
+	active().sincos(x, s, c, n);
+}
+
+void
+cdiv(double *q_re, double *q_im, const double *x_re, const double *x_im,
+	const double *y_re, const double *y_im, const std::size_t n) {
+	active().cdiv(q_re, q_im, x_re, x_im, y_re, y_im, n);
+}
+
+void
+cfma(float *x_re, float *x_im, const float *y_re, const float *y_im,
+	const float *z_re, const float *z_im, const std::size_t n) {
+	active().cfma_fv(x_re, x_im, y_re, y_im, z_re, z_im, n);
+}
+
+void
+cfma(double *x_re, double *x_im, const double *y_re, const double *y_im,
+	const float *z_re, const float *z_im, const std::size_t n) {
+	active().cfma_mv(x_re, x_im, y_re, y_im, z_re, z_im, n);
+}
+
+void
+cfma(float *x_re, float *x_im, const float *y_re, const float *y_im,
+	const float z_re, const float z_im, const std::size_t n) {
+	active().cfma_fb(x_re, x_im, y_re, y_im, z_re, z_im, n);
+}
+
+void
+cline(float *x_re, float *x_im, float *y_re, float *y_im,
+	const float *c, const float *s, const float ch, const float sh, const float z0,
+	const std::size_t n) {
+	active().cline_f(x_re, x_im, y_re, y_im, c, s, ch, sh, z0, n);
+}
+
+void
+cline(double *x_re, double *x_im, double *y_re, double *y_im,
+	const float *c, const float *s, const double ch, const double sh, const double z0,
+	const std::size_t n) {
+	active().cline_m(x_re, x_im, y_re, y_im, c, s, ch, sh, z0, n);
+}
+
+void
+sincos(const double *x, float *s, float *c, const std::size_t n) {
+	active().sincos_f(x, s, c, n);
+}
+
+void
+cdiv(float *q_re, float *q_im, const float *x_re, const float *x_im,
+	const float *y_re, const float *y_im, const std::size_t n) {
+	active().cdiv_f(q_re, q_im, x_re, x_im, y_re, y_im, n);
+}
+
+void
+convert(const double *const *p, const std::size_t n, const int to, const double z_ref, double *const *r) {
+	active().convert(p, n, to, z_ref, r);
+}
+
+const char *
+isa() {
+	return active().name;
+}
+
+}
+}
@@ -0,0 +1,88 @@
+#ifndef INCLUDED_CASPORT_KERNELS_H
+#define INCLUDED_CASPORT_KERNELS_H
+
+#include <cstddef>
+
+// Split real/imag (SoA) complex kernels used by the sweep engine. They are
+// built in several ISA variants (AVX-512, AVX2+FMA on x86-64, NEON or portable
+// loops elsewhere) and the best one the CPU supports is picked on first use.
+// CASPORT_ISA=avx2 (or generic, ...) in the environment selects a lower one.
+namespace casport {
+namespace kernels {
+
+// x[i] += z[i] * y[i]
+void cfma(double *x_re, double *x_im, const double *y_re, const double *y_im,
+	const double *z_re, const double *z_im, const std::size_t n);
+// x[i] += z * y[i]
+void cfma(double *x_re, double *x_im, const double *y_re, const double *y_im,
+	const double z_re, const double z_im, const std::size_t n);
+// (x[i], y[i]) = (p x[i] + q y[i], r x[i] + s y[i]), m = { p, q, r, s } as re/im pairs
+void crot(double *x_re, double *x_im, double *y_re, double *y_im,
+	const double *m, const std::size_t n);
+// Per lane matrix, (x[i], y[i]) = (p[i] x[i] + q[i] y[i], r[i] x[i] + s[i] y[i])
+void crotv(double *x_re, double *x_im, double *y_re, double *y_im,
+	const double *p_re, const double *p_im, const double *q_re, const double *q_im,
+	const double *r_re, const double *r_im, const double *s_re, const double *s_im, const std::size_t n);
+// Line matrix rows, cg = (ch c[i], sh s[i]), sg = (sh c[i], ch s[i]) are cosh/sinh(gamma l)
+// and (x[i], y[i]) = (cg x[i] + z0 sg y[i], sg/z0 x[i] + cg y[i])
+void cline(double *x_re, double *x_im, double *y_re, double *y_im,
+	const double *c, const double *s, const double ch, const double sh, const double z0,
+	const std::size_t n);
+// s[i] = sin(x[i]), c[i] = cos(x[i]), branch free so the loop vectorizes
+void sincos(const double *x, double *s, double *c, const std::size_t n);
+// q[i] = x[i] / y[i]
+void cdiv(double *q_re, double *q_im, const double *x_re, const double *x_im,
+	const double *y_re, const double *y_im, const std::size_t n);
+
+// Single precision, and mixed precision with double lanes and float tables
+void cfma(float *x_re, float *x_im, const float *y_re, const float *y_im,
+	const float *z_re, const float *z_im, const std::size_t n);
+void cfma(double *x_re, double *x_im, const double *y_re, const double *y_im,
+	const float *z_re, const float *z_im, const std::size_t n);
+void cfma(float *x_re, float *x_im, const float *y_re, const float *y_im,
+	const float z_re, const float z_im, const std::size_t n);
+void cline(float *x_re, float *x_im, float *y_re, float *y_im,
+	const float *c, const float *s, const float ch, const float sh, const float z0,
+	const std::size_t n);
+void cline(double *x_re, double *x_im, double *y_re, double *y_im,
+	const float *c, const float *s, const double ch, const double sh, const double z0,
+	const std::size_t n);
+void sincos(const double *x, float *s, float *c, const std::size_t n);
+void cdiv(float *q_re, float *q_im, const float *x_re, const float *x_im,
+	const float *y_re, const float *y_im, const std::size_t n);
+
+// Network parameters of n two-ports, p and r are { a_re, a_im, b_re, b_im, c_re, c_im, d_re, d_im }
+// and must not overlap
+typedef enum cvt { CONVERT_S = 1, CONVERT_Z = 2, CONVERT_Y = 3, CONVERT_T = 4 } convert_t; // as parameters_t
+void convert(const double *const *p, const std::size_t n, const int to, const double z_ref, double *const *r);
+
+const char *isa(); // name of the kernel variant in use
+
+// Entry points of one ISA variant, in declaration order above
+struct table {
+	const char *name;
+	void (*cfma_v)(double *, double *, const double *, const double *, const double *, const double *, const std::size_t);
+	void (*cfma_b)(double *, double *, const double *, const double *, const double, const double, const std::size_t);
+	void (*crot)(double *, double *, double *, double *, const double *, const std::size_t);
+	void (*crotv)(double *, double *, double *, double *, const double *, const double *, const double *, const double *,
+		const double *, const double *, const double *, const double *, const std::size_t);
+	void (*cline)(double *, double *, double *, double *, const double *, const double *, const double, const double,
+		const double, const std::size_t);
+	void (*sincos)(const double *, double *, double *, const std::size_t);
+	void (*cdiv)(double *, double *, const double *, const double *, const double *, const double *, const std::size_t);
+	void (*cfma_fv)(float *, float *, const float *, const float *, const float *, const float *, const std::size_t);
+	void (*cfma_mv)(double *, double *, const double *, const double *, const float *, const float *, const std::size_t);
+	void (*cfma_fb)(float *, float *, const float *, const float *, const float, const float, const std::size_t);
+	void (*cline_f)(float *, float *, float *, float *, const float *, const float *, const float, const float,
+		const float, const std::size_t);
+	void (*cline_m)(double *, double *, double *, double *, const float *, const float *, const double, const double,
+		const double, const std::size_t);
+	void (*sincos_f)(const double *, float *, float *, const std::size_t);
+	void (*cdiv_f)(float *, float *, const float *, const float *, const float *, const float *, const std::size_t);
+	void (*convert)(const double *const *, const std::size_t, const int, const double, double *const *);
+};
+
+}
+}
+
+#endif //INCLUDED_CASPORT_KERNELS_H
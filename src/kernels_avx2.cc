@@ -0,0 +1,3 @@
+// avx2 build of the kernels, see kernels_impl.h
+#define CASPORT_KERNELS_ISA avx2
+#include "kernels_impl.h"
@@ -0,0 +1,3 @@
+// avx512 build of the kernels, see kernels_impl.h
+#define CASPORT_KERNELS_ISA avx512
+#include "kernels_impl.h"
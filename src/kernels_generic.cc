@@ -0,0 +1,3 @@
+// generic build of the kernels, see kernels_impl.h
+#define CASPORT_KERNELS_ISA generic
+#include "kernels_impl.h"
@@ -0,0 +1,480 @@
+// Kernel bodies, compiled once per ISA variant by kernels_<isa>.cc with the
+// matching -m flags and CASPORT_KERNELS_ISA naming the variant namespace.
+// Everything here has internal linkage and only kernels.h is included: inline
+// functions from other headers would be emitted with the wider ISA and the
+// linker could pick that copy for every translation unit.
+#include "kernels.h"
+#include <cmath>
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace casport {
+namespace kernels {
+namespace CASPORT_KERNELS_ISA {
+
+static constexpr std::size_t SINCOS_CHUNK = 64;
+
+static void
+cfma(double *x_re, double *x_im, const double *y_re, const double *y_im,
+	const double *z_re, const double *z_im, const std::size_t n) {
+	std::size_t i = 0;
+#if defined(__AVX512F__)
+	for (; i + 8 <= n; i += 8) {
+		const __m512d yr = _mm512_loadu_pd(y_re + i), yi = _mm512_loadu_pd(y_im + i);
+		const __m512d zr = _mm512_loadu_pd(z_re + i), zi = _mm512_loadu_pd(z_im + i);
+		__m512d xr = _mm512_loadu_pd(x_re + i), xi = _mm512_loadu_pd(x_im + i);
+		xr = _mm512_fnmadd_pd(zi, yi, _mm512_fmadd_pd(zr, yr, xr));
+		xi = _mm512_fmadd_pd(zi, yr, _mm512_fmadd_pd(zr, yi, xi));
+		_mm512_storeu_pd(x_re + i, xr);
+		_mm512_storeu_pd(x_im + i, xi);
+	}
+#elif defined(__AVX2__) && defined(__FMA__)
+	for (; i + 4 <= n; i += 4) {
+		const __m256d yr = _mm256_loadu_pd(y_re + i), yi = _mm256_loadu_pd(y_im + i);
+		const __m256d zr = _mm256_loadu_pd(z_re + i), zi = _mm256_loadu_pd(z_im + i);
+		__m256d xr = _mm256_loadu_pd(x_re + i), xi = _mm256_loadu_pd(x_im + i);
+		xr = _mm256_fnmadd_pd(zi, yi, _mm256_fmadd_pd(zr, yr, xr));
+		xi = _mm256_fmadd_pd(zi, yr, _mm256_fmadd_pd(zr, yi, xi));
+		_mm256_storeu_pd(x_re + i, xr);
+		_mm256_storeu_pd(x_im + i, xi);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	for (; i + 2 <= n; i += 2) {
+		const float64x2_t yr = vld1q_f64(y_re + i), yi = vld1q_f64(y_im + i);
+		const float64x2_t zr = vld1q_f64(z_re + i), zi = vld1q_f64(z_im + i);
+		float64x2_t xr = vld1q_f64(x_re + i), xi = vld1q_f64(x_im + i);
+		xr = vfmsq_f64(vfmaq_f64(xr, zr, yr), zi, yi);
+		xi = vfmaq_f64(vfmaq_f64(xi, zr, yi), zi, yr);
+		vst1q_f64(x_re + i, xr);
+		vst1q_f64(x_im + i, xi);
+	}
+#endif
+	for (; i < n; i++) {
+		const double xr = x_re[i] + z_re[i] * y_re[i] - z_im[i] * y_im[i];
+		const double xi = x_im[i] + z_re[i] * y_im[i] + z_im[i] * y_re[i];
+		x_re[i] = xr;
+		x_im[i] = xi;
+	}
+}
+
+static void
+cfma(double *x_re, double *x_im, const double *y_re, const double *y_im,
+	const double z_re, const double z_im, const std::size_t n) {
+	std::size_t i = 0;
+#if defined(__AVX512F__)
+	const __m512d zr = _mm512_set1_pd(z_re), zi = _mm512_set1_pd(z_im);
+	for (; i + 8 <= n; i += 8) {
+		const __m512d yr = _mm512_loadu_pd(y_re + i), yi = _mm512_loadu_pd(y_im + i);
+		__m512d xr = _mm512_loadu_pd(x_re + i), xi = _mm512_loadu_pd(x_im + i);
+		xr = _mm512_fnmadd_pd(zi, yi, _mm512_fmadd_pd(zr, yr, xr));
+		xi = _mm512_fmadd_pd(zi, yr, _mm512_fmadd_pd(zr, yi, xi));
+		_mm512_storeu_pd(x_re + i, xr);
+		_mm512_storeu_pd(x_im + i, xi);
+	}
+#elif defined(__AVX2__) && defined(__FMA__)
+	const __m256d zr = _mm256_set1_pd(z_re), zi = _mm256_set1_pd(z_im);
+	for (; i + 4 <= n; i += 4) {
+		const __m256d yr = _mm256_loadu_pd(y_re + i), yi = _mm256_loadu_pd(y_im + i);
+		__m256d xr = _mm256_loadu_pd(x_re + i), xi = _mm256_loadu_pd(x_im + i);
+		xr = _mm256_fnmadd_pd(zi, yi, _mm256_fmadd_pd(zr, yr, xr));
+		xi = _mm256_fmadd_pd(zi, yr, _mm256_fmadd_pd(zr, yi, xi));
+		_mm256_storeu_pd(x_re + i, xr);
+		_mm256_storeu_pd(x_im + i, xi);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const float64x2_t zr = vdupq_n_f64(z_re), zi = vdupq_n_f64(z_im);
+	for (; i + 2 <= n; i += 2) {
+		const float64x2_t yr = vld1q_f64(y_re + i), yi = vld1q_f64(y_im + i);
+		float64x2_t xr = vld1q_f64(x_re + i), xi = vld1q_f64(x_im + i);
+		xr = vfmsq_f64(vfmaq_f64(xr, zr, yr), zi, yi);
+		xi = vfmaq_f64(vfmaq_f64(xi, zr, yi), zi, yr);
+		vst1q_f64(x_re + i, xr);
+		vst1q_f64(x_im + i, xi);
+	}
+#endif
+	for (; i < n; i++) {
+		const double xr = x_re[i] + z_re * y_re[i] - z_im * y_im[i];
+		const double xi = x_im[i] + z_re * y_im[i] + z_im * y_re[i];
+		x_re[i] = xr;
+		x_im[i] = xi;
+	}
+}
+
+static void
+crot(double *x_re, double *x_im, double *y_re, double *y_im,
+	const double *m, const std::size_t n) {
+	std::size_t i = 0;
+#if defined(__AVX512F__)
+	const __m512d pr = _mm512_set1_pd(m[0]), pi = _mm512_set1_pd(m[1]);
+	const __m512d qr = _mm512_set1_pd(m[2]), qi = _mm512_set1_pd(m[3]);
+	const __m512d rr = _mm512_set1_pd(m[4]), ri = _mm512_set1_pd(m[5]);
+	const __m512d sr = _mm512_set1_pd(m[6]), si = _mm512_set1_pd(m[7]);
+	for (; i + 8 <= n; i += 8) {
+		const __m512d xr = _mm512_loadu_pd(x_re + i), xi = _mm512_loadu_pd(x_im + i);
+		const __m512d yr = _mm512_loadu_pd(y_re + i), yi = _mm512_loadu_pd(y_im + i);
+		__m512d ur = _mm512_mul_pd(pr, xr), ui = _mm512_mul_pd(pr, xi);
+		ur = _mm512_fnmadd_pd(pi, xi, ur); ui = _mm512_fmadd_pd(pi, xr, ui);
+		ur = _mm512_fmadd_pd(qr, yr, ur); ui = _mm512_fmadd_pd(qr, yi, ui);
+		ur = _mm512_fnmadd_pd(qi, yi, ur); ui = _mm512_fmadd_pd(qi, yr, ui);
+		__m512d vr = _mm512_mul_pd(rr, xr), vi = _mm512_mul_pd(rr, xi);
+		vr = _mm512_fnmadd_pd(ri, xi, vr); vi = _mm512_fmadd_pd(ri, xr, vi);
+		vr = _mm512_fmadd_pd(sr, yr, vr); vi = _mm512_fmadd_pd(sr, yi, vi);
+		vr = _mm512_fnmadd_pd(si, yi, vr); vi = _mm512_fmadd_pd(si, yr, vi);
+		_mm512_storeu_pd(x_re + i, ur); _mm512_storeu_pd(x_im + i, ui);
+		_mm512_storeu_pd(y_re + i, vr); _mm512_storeu_pd(y_im + i, vi);
+	}
+#elif defined(__AVX2__) && defined(__FMA__)
+	const __m256d pr = _mm256_set1_pd(m[0]), pi = _mm256_set1_pd(m[1]);
+	const __m256d qr = _mm256_set1_pd(m[2]), qi = _mm256_set1_pd(m[3]);
+	const __m256d rr = _mm256_set1_pd(m[4]), ri = _mm256_set1_pd(m[5]);
+	const __m256d sr = _mm256_set1_pd(m[6]), si = _mm256_set1_pd(m[7]);
+	for (; i + 4 <= n; i += 4) {
+		const __m256d xr = _mm256_loadu_pd(x_re + i), xi = _mm256_loadu_pd(x_im + i);
+		const __m256d yr = _mm256_loadu_pd(y_re + i), yi = _mm256_loadu_pd(y_im + i);
+		__m256d ur = _mm256_mul_pd(pr, xr), ui = _mm256_mul_pd(pr, xi);
+		ur = _mm256_fnmadd_pd(pi, xi, ur); ui = _mm256_fmadd_pd(pi, xr, ui);
+		ur = _mm256_fmadd_pd(qr, yr, ur); ui = _mm256_fmadd_pd(qr, yi, ui);
+		ur = _mm256_fnmadd_pd(qi, yi, ur); ui = _mm256_fmadd_pd(qi, yr, ui);
+		__m256d vr = _mm256_mul_pd(rr, xr), vi = _mm256_mul_pd(rr, xi);
+		vr = _mm256_fnmadd_pd(ri, xi, vr); vi = _mm256_fmadd_pd(ri, xr, vi);
+		vr = _mm256_fmadd_pd(sr, yr, vr); vi = _mm256_fmadd_pd(sr, yi, vi);
+		vr = _mm256_fnmadd_pd(si, yi, vr); vi = _mm256_fmadd_pd(si, yr, vi);
+		_mm256_storeu_pd(x_re + i, ur); _mm256_storeu_pd(x_im + i, ui);
+		_mm256_storeu_pd(y_re + i, vr); _mm256_storeu_pd(y_im + i, vi);
+	}
+#endif
+	// Remaining lanes (and NEON, which the compiler vectorizes well from this)
+	for (; i < n; i++) {
+		const double xr = x_re[i], xi = x_im[i], yr = y_re[i], yi = y_im[i];
+		x_re[i] = m[0] * xr - m[1] * xi + m[2] * yr - m[3] * yi;
+		x_im[i] = m[0] * xi + m[1] * xr + m[2] * yi + m[3] * yr;
+		y_re[i] = m[4] * xr - m[5] * xi + m[6] * yr - m[7] * yi;
+		y_im[i] = m[4] * xi + m[5] * xr + m[6] * yi + m[7] * yr;
+	}
+}
+
+static void
+crotv(double *x_re, double *x_im, double *y_re, double *y_im,
+	const double *p_re, const double *p_im, const double *q_re, const double *q_im,
+	const double *r_re, const double *r_im, const double *s_re, const double *s_im, const std::size_t n) {
+	for (std::size_t i = 0; i < n; i++) {
+		const double xr = x_re[i], xi = x_im[i], yr = y_re[i], yi = y_im[i];
+		x_re[i] = p_re[i] * xr - p_im[i] * xi + q_re[i] * yr - q_im[i] * yi;
+		x_im[i] = p_re[i] * xi + p_im[i] * xr + q_re[i] * yi + q_im[i] * yr;
+		y_re[i] = r_re[i] * xr - r_im[i] * xi + s_re[i] * yr - s_im[i] * yi;
+		y_im[i] = r_re[i] * xi + r_im[i] * xr + s_re[i] * yi + s_im[i] * yr;
+	}
+}
+
+static void
+cline(double *__restrict x_re, double *__restrict x_im, double *__restrict y_re, double *__restrict y_im,
+	const double *__restrict c, const double *__restrict s, const double ch, const double sh, const double z0,
+	const std::size_t n) {
+	const double y0 = 1.0 / z0;
+	for (std::size_t i = 0; i < n; i++) {
+		const double xr = x_re[i], xi = x_im[i], yr = y_re[i], yi = y_im[i];
+		const double cr = ch * c[i], ci = sh * s[i]; // cosh(gamma l)
+		const double sr = sh * c[i], si = ch * s[i]; // sinh(gamma l)
+		x_re[i] = cr * xr - ci * xi + z0 * (sr * yr - si * yi);
+		x_im[i] = cr * xi + ci * xr + z0 * (sr * yi + si * yr);
+		y_re[i] = cr * yr - ci * yi + y0 * (sr * xr - si * xi);
+		y_im[i] = cr * yi + ci * yr + y0 * (sr * xi + si * xr);
+	}
+}
+
+// Cody-Waite reduction by pi/2 and the cephes minimax polynomials on [-pi/4, pi/4],
+// the quadrant is kept as a double so that every step maps to vector selects
+static void
+sincos(const double *__restrict x, double *__restrict s, double *__restrict c, const std::size_t n) {
+	const double two_over_pi = 0.63661977236758134308;
+	const double dp1 = 1.5707963267341256e+00;
+	const double dp2 = 6.0771005065061922e-11;
+	const double dp3 = 2.0222662487959506e-21;
+	for (std::size_t i = 0; i < n; i++) {
+		const double q = std::nearbyint(x[i] * two_over_pi);
+		const double r = ((x[i] - q * dp1) - q * dp2) - q * dp3;
+		const double z = r * r;
+		const double ps = r + r * z * (1.58962301576546568060e-10 * z * z * z * z * z
+			- 2.50507477628578072866e-8 * z * z * z * z + 2.75573136213857245213e-6 * z * z * z
+			- 1.98412698295895385996e-4 * z * z + 8.33333333332211858878e-3 * z
+			- 1.66666666666666307295e-1);
+		const double pc = 1.0 - 0.5 * z + z * z * (-1.13585365213876817300e-11 * z * z * z * z * z
+			+ 2.08757008419747316778e-9 * z * z * z * z - 2.75573141792967388112e-7 * z * z * z
+			+ 2.48015872888517045348e-5 * z * z - 1.38888888888730564116e-3 * z
+			+ 4.16666666666665929218e-2);
+		const double k = q - 4.0 * std::floor(q * 0.25); // quadrant 0..3
+		const bool swap = (k == 1.0) || (k == 3.0);
+		const double sv = swap ? pc : ps;
+		const double cv = swap ? ps : pc;
+		s[i] = (k >= 2.0) ? -sv : sv;
+		c[i] = (k == 1.0 || k == 2.0) ? -cv : cv;
+	}
+}
+
+static void
+cdiv(double *q_re, double *q_im, const double *x_re, const double *x_im,
+	const double *y_re, const double *y_im, const std::size_t n) {
+	// Plain loop, vectorized by the compiler
+	for (std::size_t i = 0; i < n; i++) {
+		const double den = 1.0 / (y_re[i] * y_re[i] + y_im[i] * y_im[i]);
+		const double qr = (x_re[i] * y_re[i] + x_im[i] * y_im[i]) * den;
+		const double qi = (x_im[i] * y_re[i] - x_re[i] * y_im[i]) * den;
+		q_re[i] = qr;
+		q_im[i] = qi;
+	}
+}
+
+// Single and mixed precision: plain loops in the arithmetic of the destination X,
+// with Z the storage of the tables, vectorized by the compiler
+template<typename X, typename Z>
+static inline void
+cfma_plain(X *__restrict x_re, X *__restrict x_im, const X *__restrict y_re, const X *__restrict y_im,
+	const Z *__restrict z_re, const Z *__restrict z_im, const std::size_t n) {
+	for (std::size_t i = 0; i < n; i++) {
+		const X zr = z_re[i], zi = z_im[i];
+		x_re[i] += zr * y_re[i] - zi * y_im[i];
+		x_im[i] += zr * y_im[i] + zi * y_re[i];
+	}
+}
+
+template<typename X, typename Z>
+static inline void
+cline_plain(X *__restrict x_re, X *__restrict x_im, X *__restrict y_re, X *__restrict y_im,
+	const Z *__restrict c, const Z *__restrict s, const X ch, const X sh, const X z0, const std::size_t n) {
+	const X y0 = X(1) / z0;
+	for (std::size_t i = 0; i < n; i++) {
+		const X xr = x_re[i], xi = x_im[i], yr = y_re[i], yi = y_im[i];
+		const X cr = ch * c[i], ci = sh * s[i];
+		const X sr = sh * c[i], si = ch * s[i];
+		x_re[i] = cr * xr - ci * xi + z0 * (sr * yr - si * yi);
+		x_im[i] = cr * xi + ci * xr + z0 * (sr * yi + si * yr);
+		y_re[i] = cr * yr - ci * yi + y0 * (sr * xr - si * xi);
+		y_im[i] = cr * yi + ci * yr + y0 * (sr * xi + si * xr);
+	}
+}
+
+// Float lanes, twice as many per vector as the double kernels
+static void
+cfma(float *x_re, float *x_im, const float *y_re, const float *y_im,
+	const float *z_re, const float *z_im, const std::size_t n) {
+	std::size_t i = 0;
+#if defined(__AVX512F__)
+	for (; i + 16 <= n; i += 16) {
+		const __m512 yr = _mm512_loadu_ps(y_re + i), yi = _mm512_loadu_ps(y_im + i);
+		const __m512 zr = _mm512_loadu_ps(z_re + i), zi = _mm512_loadu_ps(z_im + i);
+		__m512 xr = _mm512_loadu_ps(x_re + i), xi = _mm512_loadu_ps(x_im + i);
+		xr = _mm512_fnmadd_ps(zi, yi, _mm512_fmadd_ps(zr, yr, xr));
+		xi = _mm512_fmadd_ps(zi, yr, _mm512_fmadd_ps(zr, yi, xi));
+		_mm512_storeu_ps(x_re + i, xr);
+		_mm512_storeu_ps(x_im + i, xi);
+	}
+#elif defined(__AVX2__) && defined(__FMA__)
+	for (; i + 8 <= n; i += 8) {
+		const __m256 yr = _mm256_loadu_ps(y_re + i), yi = _mm256_loadu_ps(y_im + i);
+		const __m256 zr = _mm256_loadu_ps(z_re + i), zi = _mm256_loadu_ps(z_im + i);
+		__m256 xr = _mm256_loadu_ps(x_re + i), xi = _mm256_loadu_ps(x_im + i);
+		xr = _mm256_fnmadd_ps(zi, yi, _mm256_fmadd_ps(zr, yr, xr));
+		xi = _mm256_fmadd_ps(zi, yr, _mm256_fmadd_ps(zr, yi, xi));
+		_mm256_storeu_ps(x_re + i, xr);
+		_mm256_storeu_ps(x_im + i, xi);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	for (; i + 4 <= n; i += 4) {
+		const float32x4_t yr = vld1q_f32(y_re + i), yi = vld1q_f32(y_im + i);
+		const float32x4_t zr = vld1q_f32(z_re + i), zi = vld1q_f32(z_im + i);
+		float32x4_t xr = vld1q_f32(x_re + i), xi = vld1q_f32(x_im + i);
+		xr = vfmsq_f32(vfmaq_f32(xr, zr, yr), zi, yi);
+		xi = vfmaq_f32(vfmaq_f32(xi, zr, yi), zi, yr);
+		vst1q_f32(x_re + i, xr);
+		vst1q_f32(x_im + i, xi);
+	}
+#endif
+	cfma_plain(x_re + i, x_im + i, y_re + i, y_im + i, z_re + i, z_im + i, n - i);
+}
+
+static void
+cfma(double *x_re, double *x_im, const double *y_re, const double *y_im,
+	const float *z_re, const float *z_im, const std::size_t n) {
+	cfma_plain(x_re, x_im, y_re, y_im, z_re, z_im, n);
+}
+
+static void
+cfma(float *x_re, float *x_im, const float *y_re, const float *y_im,
+	const float z_re, const float z_im, const std::size_t n) {
+	std::size_t i = 0;
+#if defined(__AVX512F__)
+	const __m512 zr = _mm512_set1_ps(z_re), zi = _mm512_set1_ps(z_im);
+	for (; i + 16 <= n; i += 16) {
+		const __m512 yr = _mm512_loadu_ps(y_re + i), yi = _mm512_loadu_ps(y_im + i);
+		__m512 xr = _mm512_loadu_ps(x_re + i), xi = _mm512_loadu_ps(x_im + i);
+		xr = _mm512_fnmadd_ps(zi, yi, _mm512_fmadd_ps(zr, yr, xr));
+		xi = _mm512_fmadd_ps(zi, yr, _mm512_fmadd_ps(zr, yi, xi));
+		_mm512_storeu_ps(x_re + i, xr);
+		_mm512_storeu_ps(x_im + i, xi);
+	}
+#elif defined(__AVX2__) && defined(__FMA__)
+	const __m256 zr = _mm256_set1_ps(z_re), zi = _mm256_set1_ps(z_im);
+	for (; i + 8 <= n; i += 8) {
+		const __m256 yr = _mm256_loadu_ps(y_re + i), yi = _mm256_loadu_ps(y_im + i);
+		__m256 xr = _mm256_loadu_ps(x_re + i), xi = _mm256_loadu_ps(x_im + i);
+		xr = _mm256_fnmadd_ps(zi, yi, _mm256_fmadd_ps(zr, yr, xr));
+		xi = _mm256_fmadd_ps(zi, yr, _mm256_fmadd_ps(zr, yi, xi));
+		_mm256_storeu_ps(x_re + i, xr);
+		_mm256_storeu_ps(x_im + i, xi);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const float32x4_t zr = vdupq_n_f32(z_re), zi = vdupq_n_f32(z_im);
+	for (; i + 4 <= n; i += 4) {
+		const float32x4_t yr = vld1q_f32(y_re + i), yi = vld1q_f32(y_im + i);
+		float32x4_t xr = vld1q_f32(x_re + i), xi = vld1q_f32(x_im + i);
+		xr = vfmsq_f32(vfmaq_f32(xr, zr, yr), zi, yi);
+		xi = vfmaq_f32(vfmaq_f32(xi, zr, yi), zi, yr);
+		vst1q_f32(x_re + i, xr);
+		vst1q_f32(x_im + i, xi);
+	}
+#endif
+	for (; i < n; i++) {
+		const float xr = x_re[i] + z_re * y_re[i] - z_im * y_im[i];
+		const float xi = x_im[i] + z_re * y_im[i] + z_im * y_re[i];
+		x_re[i] = xr;
+		x_im[i] = xi;
+	}
+}
+
+static void
+cline(float *x_re, float *x_im, float *y_re, float *y_im,
+	const float *c, const float *s, const float ch, const float sh, const float z0,
+	const std::size_t n) {
+	cline_plain(x_re, x_im, y_re, y_im, c, s, ch, sh, z0, n);
+}
+
+static void
+cline(double *x_re, double *x_im, double *y_re, double *y_im,
+	const float *c, const float *s, const double ch, const double sh, const double z0,
+	const std::size_t n) {
+	cline_plain(x_re, x_im, y_re, y_im, c, s, ch, sh, z0, n);
+}
+
+// Reduced and evaluated in double, only the tables are narrowed
+static void
+sincos(const double *x, float *s, float *c, const std::size_t n) {
+	alignas(64) double sd[SINCOS_CHUNK], cd[SINCOS_CHUNK];
+	for (std::size_t k = 0; k < n; k += SINCOS_CHUNK) {
+		const std::size_t m = (n - k < SINCOS_CHUNK) ? n - k : SINCOS_CHUNK;
+		sincos(x + k, sd, cd, m);
+		for (std::size_t i = 0; i < m; i++) {
+			s[k + i] = static_cast<float>(sd[i]);
+			c[k + i] = static_cast<float>(cd[i]);
+		}
+	}
+}
+
+static void
+cdiv(float *q_re, float *q_im, const float *x_re, const float *x_im,
+	const float *y_re, const float *y_im, const std::size_t n) {
+	for (std::size_t i = 0; i < n; i++) {
+		const float den = 1.0f / (y_re[i] * y_re[i] + y_im[i] * y_im[i]);
+		const float qr = (x_re[i] * y_re[i] + x_im[i] * y_im[i]) * den;
+		const float qi = (x_im[i] * y_re[i] - x_re[i] * y_im[i]) * den;
+		q_re[i] = qr;
+		q_im[i] = qi;
+	}
+}
+
+// Network parameters from A B C D, p and r hold re/im of a, b, c, d in turn
+namespace {
+struct cv {
+	double re;
+	double im;
+};
+}
+
+static inline cv operator+(const cv x, const cv y) { return cv{ x.re + y.re, x.im + y.im }; }
+static inline cv operator-(const cv x, const cv y) { return cv{ x.re - y.re, x.im - y.im }; }
+static inline cv operator-(const cv x) { return cv{ -x.re, -x.im }; }
+static inline cv operator*(const double s, const cv x) { return cv{ s * x.re, s * x.im }; }
+static inline cv operator*(const cv x, const cv y) { return cv{ x.re * y.re - x.im * y.im, x.re * y.im + x.im * y.re }; }
+
+static inline cv
+inv(const cv x) {
+	const double den = 1.0 / (x.re * x.re + x.im * x.im);
+	return cv{ x.re * den, -x.im * den };
+}
+
+static void
+convert(const double *const *p, const std::size_t n, const int to, const double z_ref, double *const *r) {
+	const double *__restrict a_re = p[0], *__restrict a_im = p[1], *__restrict b_re = p[2], *__restrict b_im = p[3];
+	const double *__restrict c_re = p[4], *__restrict c_im = p[5], *__restrict d_re = p[6], *__restrict d_im = p[7];
+	double *__restrict p_re = r[0], *__restrict p_im = r[1], *__restrict q_re = r[2], *__restrict q_im = r[3];
+	double *__restrict u_re = r[4], *__restrict u_im = r[5], *__restrict v_re = r[6], *__restrict v_im = r[7];
+	const double g = 1.0 / z_ref;
+	switch (to) {
+	case CONVERT_S:
+		for (std::size_t i = 0; i < n; i++) {
+			const cv a = cv{ a_re[i], a_im[i] }, b = g * cv{ b_re[i], b_im[i] };
+			const cv c = z_ref * cv{ c_re[i], c_im[i] }, d = cv{ d_re[i], d_im[i] };
+			const cv den = inv(a + b + c + d);
+			const cv s11 = (a + b - c - d) * den, s12 = 2.0 * (a * d - b * c) * den;
+			const cv s21 = 2.0 * den, s22 = (b - a - c + d) * den;
+			p_re[i] = s11.re; p_im[i] = s11.im; q_re[i] = s12.re; q_im[i] = s12.im;
+			u_re[i] = s21.re; u_im[i] = s21.im; v_re[i] = s22.re; v_im[i] = s22.im;
+		}
+		break;
+	case CONVERT_Z:
+		for (std::size_t i = 0; i < n; i++) {
+			const cv a = cv{ a_re[i], a_im[i] }, b = cv{ b_re[i], b_im[i] };
+			const cv c = cv{ c_re[i], c_im[i] }, d = cv{ d_re[i], d_im[i] };
+			const cv y = inv(c);
+			const cv z11 = a * y, z12 = (a * d - b * c) * y, z22 = d * y;
+			p_re[i] = z11.re; p_im[i] = z11.im; q_re[i] = z12.re; q_im[i] = z12.im;
+			u_re[i] = y.re; u_im[i] = y.im; v_re[i] = z22.re; v_im[i] = z22.im;
+		}
+		break;
+	case CONVERT_Y:
+		for (std::size_t i = 0; i < n; i++) {
+			const cv a = cv{ a_re[i], a_im[i] }, b = cv{ b_re[i], b_im[i] };
+			const cv c = cv{ c_re[i], c_im[i] }, d = cv{ d_re[i], d_im[i] };
+			const cv z = inv(b);
+			const cv y11 = d * z, y12 = -((a * d - b * c) * z), y21 = -z, y22 = a * z;
+			p_re[i] = y11.re; p_im[i] = y11.im; q_re[i] = y12.re; q_im[i] = y12.im;
+			u_re[i] = y21.re; u_im[i] = y21.im; v_re[i] = y22.re; v_im[i] = y22.im;
+		}
+		break;
+	case CONVERT_T:
+		for (std::size_t i = 0; i < n; i++) {
+			const cv a = cv{ a_re[i], a_im[i] }, b = g * cv{ b_re[i], b_im[i] };
+			const cv c = z_ref * cv{ c_re[i], c_im[i] }, d = cv{ d_re[i], d_im[i] };
+			const cv t11 = 0.5 * (a + b + c + d), t12 = 0.5 * (a - b + c - d);
+			const cv t21 = 0.5 * (a + b - c - d), t22 = 0.5 * (a - b - c + d);
+			p_re[i] = t11.re; p_im[i] = t11.im; q_re[i] = t12.re; q_im[i] = t12.im;
+			u_re[i] = t21.re; u_im[i] = t21.im; v_re[i] = t22.re; v_im[i] = t22.im;
+		}
+		break;
+	}
+}
+
+#if defined(__AVX512F__)
+static const char NAME[] = "avx512";
+#elif defined(__AVX2__) && defined(__FMA__)
+static const char NAME[] = "avx2";
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static const char NAME[] = "neon";
+#else
+static const char NAME[] = "generic";
+#endif
+
+extern const table TABLE;
+const table TABLE = {
+	NAME,
+	cfma, cfma, crot, crotv, cline, sincos, cdiv,
+	cfma, cfma, cfma, cline, cline, sincos, cdiv,
+	convert
+};
+
+}
+}
+}
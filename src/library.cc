@@ -0,0 +1,414 @@
+#include "../include/casport_library.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace casport{
+
+namespace {
+typedef enum sct {
+	FIRST = 0, Z0 = 1, FREQUENCY = 2, NAME = 3, BY_NAME = 4, COMPONENT = 5, MOUNT = 6, VALUE = 7, IMPEDANCE = 8,
+	ALPHA = 9, NAMES = 10, SECTIONS = 11
+} section_t;
+
+struct file_header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byte_order;
+	std::uint64_t circuits;
+	std::uint64_t elements;
+	std::uint64_t names;
+	std::uint64_t size;
+	std::uint64_t reserved[2];
+	std::uint64_t offset[SECTIONS];
+};
+}
+
+static constexpr char MAGIC[8] = { 'C', 'A', 'S', 'P', 'L', 'I', 'B', '\0' };
+static constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+static constexpr std::size_t SECTION_ALIGN = 64;
+
+// Bytes of every section for c circuits, e elements and n name bytes
+static void
+section_bytes(const std::uint64_t c, const std::uint64_t e, const std::uint64_t n, std::uint64_t *bytes) {
+	bytes[FIRST] = 8 * (c + 1);
+	bytes[Z0] = 16 * c;
+	bytes[FREQUENCY] = 8 * c;
+	bytes[NAME] = 8 * (c + 1);
+	bytes[BY_NAME] = 8 * c;
+	bytes[COMPONENT] = e;
+	bytes[MOUNT] = e;
+	bytes[VALUE] = 16 * e;
+	bytes[IMPEDANCE] = 8 * e;
+	bytes[ALPHA] = 8 * e;
+	bytes[NAMES] = n;
+}
+
+bool
+library_writer::add(const circuit &c, const std::string_view name) {
+	for (std::size_t i = 0; i < c.size(); i++) {
+		if (c[i].is_block()) { return false; }
+	}
+	for (std::size_t i = 0; i < c.size(); i++) {
+		const element &e = c[i];
+		m_component.push_back(static_cast<unsigned char>(e.component()));
+		m_mount.push_back(static_cast<unsigned char>(e.mount()));
+		m_value.push_back(std::real(e.value()));
+		m_value.push_back(std::imag(e.value()));
+		m_impedance.push_back(e.z0());
+		m_alpha.push_back(e.alpha());
+	}
+	m_first.push_back(m_component.size());
+	m_z0.push_back(std::real(c.z0()));
+	m_z0.push_back(std::imag(c.z0()));
+	m_frequency.push_back(c.frequency());
+	m_names.append(name);
+	m_name.push_back(m_names.size());
+	return true;
+}
+
+std::vector<unsigned char>
+library_writer::image() const {
+	const std::uint64_t c = size(), e = m_component.size(), n = m_names.size();
+	file_header h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.version = LIBRARY_VERSION;
+	h.byte_order = BYTE_ORDER_MARK;
+	h.circuits = c;
+	h.elements = e;
+	h.names = n;
+	std::uint64_t bytes[SECTIONS];
+	section_bytes(c, e, n, bytes);
+	std::uint64_t at = sizeof(file_header);
+	for (std::size_t s = 0; s < SECTIONS; s++) {
+		at = (at + SECTION_ALIGN - 1) / SECTION_ALIGN * SECTION_ALIGN;
+		h.offset[s] = at;
+		at += bytes[s];
+	}
+	h.size = at;
+
+	std::vector<std::uint64_t> by_name(c);
+	std::iota(by_name.begin(), by_name.end(), std::uint64_t(0));
+	const auto name_of = [&](const std::uint64_t i) {
+		return std::string_view(m_names).substr(m_name[i], m_name[i + 1] - m_name[i]);
+	};
+	std::stable_sort(by_name.begin(), by_name.end(),
+		[&](const std::uint64_t a, const std::uint64_t b) { return name_of(a) < name_of(b); });
+
+	std::vector<unsigned char> out(h.size, 0);
+	std::memcpy(out.data(), &h, sizeof(h));
+	const void *from[SECTIONS] = { m_first.data(), m_z0.data(), m_frequency.data(), m_name.data(), by_name.data(), m_component.data(),
+		m_mount.data(), m_value.data(), m_impedance.data(), m_alpha.data(), m_names.data() };
+	for (std::size_t s = 0; s < SECTIONS; s++) {
+		if (bytes[s] > 0) { std::memcpy(out.data() + h.offset[s], from[s], bytes[s]); }
+	}
+	return out;
+}
+
+library_error_t
+library_writer::write(const char *path) const {
+	const std::vector<unsigned char> bytes = image();
+	std::FILE *out = std::fopen(path, "wb");
+	if (out == nullptr) { return library_error_t{ "cannot open file" }; }
+	const bool written = std::fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+	if (std::fclose(out) != 0 || !written) { return library_error_t{ "cannot write file" }; }
+	return library_error_t{ nullptr };
+}
+
+element
+circuit_view::operator[](const std::size_t i) const {
+	const element_t e = static_cast<element_t>(m_component[i]);
+	const mount_t m = static_cast<mount_t>(m_mount[i]);
+	switch (e) {
+	case TRL:
+		return element(m_value[2 * i], m_impedance[i], m_alpha[i]);
+	case OCS:
+	case SCS:
+		return element(e, m, m_value[2 * i], m_impedance[i]);
+	default:
+		break;
+	}
+	return element(e, m, cxd_t(m_value[2 * i], m_value[2 * i + 1]));
+}
+
+cxd_t
+circuit_view::input_impedance(const double f) const {
+	if (m_size == 0) { return cxd_t(std::nan(""), std::nan("")); }
+	cxd_t abcd[4] = { cxd_t(1.0, 0.0), cxd_t(0.0, 0.0),
+					  cxd_t(0.0, 0.0), cxd_t(1.0, 0.0) };
+	for (std::size_t i = m_size; i-- > 0;) {
+		const element_t e = static_cast<element_t>(m_component[i]);
+		const cxd_t v(m_value[2 * i], m_value[2 * i + 1]);
+		if (e == TRL) {
+			cxd_t m[4];
+			detail::trl_abcd(std::real(v), m_impedance[i], m_alpha[i], f, m);
+			detail::flma2(m, abcd);
+		} else if (m_mount[i] == SHUNT) {
+			detail::flma<SHUNT>(detail::admittance(e, v, m_impedance[i], f), abcd);
+		} else {
+			detail::flma<SERIES>(detail::impedance(e, v, m_impedance[i], f), abcd);
+		}
+	}
+	return abcd[0] / abcd[2];
+}
+
+// The terms of element::immittance and circuit::chain taken from the arrays,
+// so views and circuits give the same sweeps
+void
+circuit_view::input_impedance(const double *f, const std::size_t n, cxd_t *zin) const {
+	if (m_size == 0) {
+		for (std::size_t i = 0; i < n; i++) { zin[i] = cxd_t(std::nan(""), std::nan("")); }
+		return;
+	}
+	abcd_soa abcd;
+	alignas(64) double f_rec[SWEEP_BLOCK], theta[SWEEP_BLOCK], c[SWEEP_BLOCK], s[SWEEP_BLOCK];
+	alignas(64) double x_re[SWEEP_BLOCK], x_im[SWEEP_BLOCK];
+	for (std::size_t k = 0; k < n; k += SWEEP_BLOCK) {
+		const std::size_t m = std::min(SWEEP_BLOCK, n - k);
+		for (std::size_t i = 0; i < m; i++) { f_rec[i] = 1.0 / f[k + i]; }
+		abcd.identity(m);
+		for (std::size_t i = m_size; i-- > 0;) {
+			const element_t e = static_cast<element_t>(m_component[i]);
+			const bool shunt = (m_mount[i] == SHUNT);
+			const cxd_t v(m_value[2 * i], m_value[2 * i + 1]);
+			if (e == TRL || e == OCS || e == SCS) {
+				const double p = detail::phase_per_hz(std::real(v));
+				for (std::size_t j = 0; j < m; j++) { theta[j] = p * f[k + j]; }
+				kernels::sincos(theta, s, c, m);
+			}
+			switch (e) {
+			case TRL: {
+				const double l = std::real(v);
+				const double ch = std::cosh(m_alpha[i] * l), sh = std::sinh(m_alpha[i] * l);
+				kernels::cline(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, c, s, ch, sh, m_impedance[i], m);
+				kernels::cline(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, c, s, ch, sh, m_impedance[i], m);
+				}
+				continue;
+			case RES: {
+				const cxd_t x = shunt ? detail::admittance(RES, v, 0.0, 0.0) : detail::impedance(RES, v, 0.0, 0.0);
+				std::fill(x_re, x_re + m, std::real(x));
+				std::fill(x_im, x_im + m, std::imag(x));
+				}
+				break;
+			case CAP:
+			case IND:
+				if ((e == CAP) == shunt) {
+					const cxd_t g = cxd_t(0.0, 2.0 * M_PI) * v; // jwC or jwL
+					for (std::size_t j = 0; j < m; j++) {
+						x_re[j] = std::real(g) * f[k + j];
+						x_im[j] = std::imag(g) * f[k + j];
+					}
+				} else {
+					const cxd_t g = 1.0 / (cxd_t(0.0, 2.0 * M_PI) * v); // 1/(jwC) or 1/(jwL)
+					for (std::size_t j = 0; j < m; j++) {
+						x_re[j] = std::real(g) * f_rec[j];
+						x_im[j] = std::imag(g) * f_rec[j];
+					}
+				}
+				break;
+			case OCS:
+			case SCS: {
+				const double z0 = m_impedance[i];
+				std::fill(x_re, x_re + m, 0.0);
+				if ((e == SCS) != shunt) {
+					const double g = shunt ? 1.0 / z0 : z0;
+					for (std::size_t j = 0; j < m; j++) { x_im[j] = g * s[j] / c[j]; }
+				} else {
+					const double g = shunt ? -1.0 / z0 : -z0;
+					for (std::size_t j = 0; j < m; j++) { x_im[j] = g * c[j] / s[j]; }
+				}
+				}
+				break;
+			default:
+				continue; // no subcircuits in libraries
+			}
+			if (shunt) {
+				kernels::cfma(abcd.c_re, abcd.c_im, abcd.a_re, abcd.a_im, x_re, x_im, m);
+				kernels::cfma(abcd.d_re, abcd.d_im, abcd.b_re, abcd.b_im, x_re, x_im, m);
+			} else {
+				kernels::cfma(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, x_re, x_im, m);
+				kernels::cfma(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, x_re, x_im, m);
+			}
+		}
+		kernels::cdiv(x_re, x_im, abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, m);
+		for (std::size_t i = 0; i < m; i++) { zin[k + i] = cxd_t(x_re[i], x_im[i]); }
+	}
+}
+
+circuit
+circuit_view::to_circuit(std::pmr::memory_resource *mr) const {
+	circuit c(z0(), mr);
+	c.reserve(m_size);
+	c.pop_back(); // the stored elements include the load
+	for (std::size_t i = 0; i < m_size; i++) { c.push_back((*this)[i]); }
+	c.set_frequency(*m_frequency);
+	return c;
+}
+
+circuit_library::circuit_library() :
+	m_data(nullptr), m_bytes(0), m_mapped(false), m_circuits(0), m_first(nullptr), m_z0(nullptr), m_frequency(nullptr),
+	m_name(nullptr), m_by_name(nullptr), m_component(nullptr), m_mount(nullptr), m_value(nullptr),
+	m_impedance(nullptr), m_alpha(nullptr), m_names(nullptr) {
+}
+
+circuit_library::~circuit_library() {
+	close();
+}
+
+circuit_library::circuit_library(circuit_library &&other) : circuit_library() {
+	*this = std::move(other);
+}
+
+circuit_library &
+circuit_library::operator=(circuit_library &&other) {
+	if (this != &other) {
+		close();
+		m_data = other.m_data;
+		m_bytes = other.m_bytes;
+		m_mapped = other.m_mapped;
+		m_circuits = other.m_circuits;
+		m_first = other.m_first;
+		m_z0 = other.m_z0;
+		m_frequency = other.m_frequency;
+		m_name = other.m_name;
+		m_by_name = other.m_by_name;
+		m_component = other.m_component;
+		m_mount = other.m_mount;
+		m_value = other.m_value;
+		m_impedance = other.m_impedance;
+		m_alpha = other.m_alpha;
+		m_names = other.m_names;
+		other.m_mapped = false; // the mapping moves with the pointers
+		other.close();
+	}
+	return *this;
+}
+
+void
+circuit_library::close() {
+	if (m_mapped && m_data != nullptr) { ::munmap(const_cast<unsigned char *>(m_data), m_bytes); }
+	m_data = nullptr;
+	m_bytes = 0;
+	m_mapped = false;
+	m_circuits = 0;
+}
+
+library_error_t
+circuit_library::open(const char *path) {
+	close();
+	const int fd = ::open(path, O_RDONLY);
+	if (fd < 0) { return library_error_t{ "cannot open file" }; }
+	struct stat st;
+	if (::fstat(fd, &st) != 0) { ::close(fd); return library_error_t{ "cannot open file" }; }
+	const std::size_t size = static_cast<std::size_t>(st.st_size);
+	if (size < sizeof(file_header)) { ::close(fd); return library_error_t{ "not a circuit library" }; }
+	// Shared, so processes mapping one file share its pages
+	void *map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) { return library_error_t{ "cannot map file" }; }
+	const library_error_t r = open(map, size);
+	if (r.message != nullptr) {
+		::munmap(map, size);
+		return r;
+	}
+	m_mapped = true;
+	return r;
+}
+
+// Checks what evaluation relies on, the header, the index arrays and the
+// component, mount and line z0 of every element, O(circuits + elements)
+library_error_t
+circuit_library::open(const void *data, const std::size_t size) {
+	close();
+	if (reinterpret_cast<std::uintptr_t>(data) % 8 != 0) { return library_error_t{ "library is not 8 byte aligned" }; }
+	if (size < sizeof(file_header)) { return library_error_t{ "not a circuit library" }; }
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	file_header h;
+	std::memcpy(&h, p, sizeof(h));
+	if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) { return library_error_t{ "not a circuit library" }; }
+	if (h.byte_order != BYTE_ORDER_MARK) { return library_error_t{ "library has another byte order" }; }
+	if (h.version != LIBRARY_VERSION) { return library_error_t{ "unsupported library version" }; }
+	if (h.size != size || h.circuits > size || h.elements > size || h.names > size) {
+		return library_error_t{ "library is truncated" };
+	}
+	std::uint64_t bytes[SECTIONS];
+	section_bytes(h.circuits, h.elements, h.names, bytes);
+	for (std::size_t s = 0; s < SECTIONS; s++) {
+		if (h.offset[s] % 8 != 0 || h.offset[s] > size || bytes[s] > size - h.offset[s]) {
+			return library_error_t{ "library is truncated" };
+		}
+	}
+	const std::uint64_t *first = reinterpret_cast<const std::uint64_t *>(p + h.offset[FIRST]);
+	const std::uint64_t *name = reinterpret_cast<const std::uint64_t *>(p + h.offset[NAME]);
+	const std::uint64_t *by_name = reinterpret_cast<const std::uint64_t *>(p + h.offset[BY_NAME]);
+	if (first[0] != 0 || first[h.circuits] != h.elements || name[0] != 0 || name[h.circuits] != h.names) {
+		return library_error_t{ "library index is corrupt" };
+	}
+	for (std::size_t i = 0; i < h.circuits; i++) {
+		if (first[i + 1] < first[i] || name[i + 1] < name[i] || by_name[i] >= h.circuits) {
+			return library_error_t{ "library index is corrupt" };
+		}
+	}
+	const unsigned char *component = p + h.offset[COMPONENT], *mount = p + h.offset[MOUNT];
+	const double *impedance = reinterpret_cast<const double *>(p + h.offset[IMPEDANCE]);
+	for (std::size_t i = 0; i < h.elements; i++) {
+		const element_t e = static_cast<element_t>(component[i]);
+		if (component[i] > SCS || (mount[i] != SHUNT && mount[i] != SERIES) ||
+			((e == TRL || e == OCS || e == SCS) && !(impedance[i] > 0.0))) {
+			return library_error_t{ "library element is corrupt" };
+		}
+	}
+
+	m_data = p;
+	m_bytes = size;
+	m_circuits = h.circuits;
+	m_first = first;
+	m_z0 = reinterpret_cast<const double *>(p + h.offset[Z0]);
+	m_frequency = reinterpret_cast<const double *>(p + h.offset[FREQUENCY]);
+	m_name = name;
+	m_by_name = by_name;
+	m_component = component;
+	m_mount = mount;
+	m_value = reinterpret_cast<const double *>(p + h.offset[VALUE]);
+	m_impedance = impedance;
+	m_alpha = reinterpret_cast<const double *>(p + h.offset[ALPHA]);
+	m_names = reinterpret_cast<const char *>(p + h.offset[NAMES]);
+	return library_error_t{ nullptr };
+}
+
+circuit_view
+circuit_library::operator[](const std::size_t i) const {
+	circuit_view v;
+	const std::size_t e = m_first[i];
+	v.m_size = m_first[i + 1] - e;
+	v.m_z0 = m_z0 + 2 * i;
+	v.m_frequency = m_frequency + i;
+	v.m_name = std::string_view(m_names + m_name[i], m_name[i + 1] - m_name[i]);
+	v.m_component = m_component + e;
+	v.m_mount = m_mount + e;
+	v.m_value = m_value + 2 * e;
+	v.m_impedance = m_impedance + e;
+	v.m_alpha = m_alpha + e;
+	return v;
+}
+
+bool
+circuit_library::find(const std::string_view name, std::size_t &i) const {
+	const auto name_of = [&](const std::uint64_t j) {
+		return std::string_view(m_names + m_name[j], m_name[j + 1] - m_name[j]);
+	};
+	const std::uint64_t *at = std::lower_bound(m_by_name, m_by_name + m_circuits, name,
+		[&](const std::uint64_t j, const std::string_view n) { return name_of(j) < n; });
+	if (at == m_by_name + m_circuits || name_of(*at) != name) { return false; }
+	i = static_cast<std::size_t>(*at);
+	return true;
+}
+
+}
@@ -0,0 +1,165 @@
+#include "../include/casport_montecarlo.h"
+#include "device.h"
+#include "kernels.h"
+#include "random.h"
+#include <algorithm>
+#include <atomic>
+
+namespace casport{
+
+monte_carlo::monte_carlo(const circuit &c, const std::uint64_t seed) :
+	m_circuit(c), m_tolerances(c.size(), tolerance_t{FIXED, 0.0}), m_seed(seed), m_revision(1),
+	m_backend(AUTO_BACKEND) {
+}
+
+void
+monte_carlo::set_tolerance(const std::size_t i, const tolerance_t t) {
+	if (i < m_tolerances.size()) { m_tolerances[i] = t; m_revision++; }
+}
+
+void
+monte_carlo::set_tolerance(const element_t component, const tolerance_t t) {
+	// The load, the last element, keeps its tolerance
+	for (std::size_t i = 0; i + 1 < m_circuit.size(); i++) {
+		if (m_circuit[i].component() == component) { m_tolerances[i] = t; }
+	}
+	m_revision++;
+}
+
+double
+monte_carlo::scale(const std::size_t i, const std::uint64_t trial) const {
+	return random::scale(m_tolerances[i], m_seed, i, trial);
+}
+
+// Up to SWEEP_BLOCK trials, one per lane, scales holds size() x SWEEP_BLOCK multipliers
+void
+monte_carlo::batch(const double *f, const std::size_t n, const std::uint64_t first,
+	const std::size_t trials, double *scales, cxd_t *zin) const {
+	const std::size_t n_el = m_circuit.size();
+	for (std::size_t i = 0; i < n_el; i++) {
+		if (m_tolerances[i].dist == FIXED) { continue; }
+		for (std::size_t t = 0; t < trials; t++) {
+			scales[i * SWEEP_BLOCK + t] = scale(i, first + t);
+		}
+	}
+
+	// Subcircuits have no value to vary, their sweep is the same in every trial
+	std::vector<subcircuit::table_t> tables(n_el);
+	for (std::size_t i = 0; i < n_el; i++) {
+		if (m_circuit[i].is_block()) { tables[i] = m_circuit[i].block()->sweep(f, n); }
+	}
+
+	abcd_soa abcd;
+	alignas(64) double x_re[SWEEP_BLOCK], x_im[SWEEP_BLOCK];
+	alignas(64) double fk[SWEEP_BLOCK];
+	for (std::size_t k = 0; k < n; k++) {
+		std::fill(fk, fk + trials, f[k]);
+		abcd.identity(trials);
+		for (std::size_t i = n_el; i-- > 0;) {
+			const element &e = m_circuit[i];
+			if (e.is_block()) {
+				const double *t = tables[i]->data() + k;
+				const double m[8] = { t[0], t[n], t[2 * n], t[3 * n], t[4 * n], t[5 * n], t[6 * n], t[7 * n] };
+				kernels::crot(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, m, trials);
+				kernels::crot(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, m, trials);
+			} else if (m_tolerances[i].dist != FIXED) {
+				e.flma(abcd, f[k], scales + i * SWEEP_BLOCK, trials);
+			} else if (e.is_line()) {
+				e.flma(abcd, fk, trials);
+			} else {
+				e.flma(abcd, e.immittance(f[k]), trials);
+			}
+		}
+		kernels::cdiv(x_re, x_im, abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, trials);
+		for (std::size_t t = 0; t < trials; t++) {
+			zin[t * n + k] = cxd_t(x_re[t], x_im[t]);
+		}
+	}
+}
+
+// Sends the tolerances first if they changed since the last device run
+bool
+monte_carlo::device_run(const double *f, const std::size_t n, const std::uint64_t first,
+	const std::size_t trials, cxd_t *zin) const {
+	std::lock_guard<std::mutex> guard(m_device.m_lock);
+	if (m_device.m_tables == nullptr) {
+		for (std::size_t i = 0; i < m_circuit.size(); i++) {
+			if (std::imag(m_circuit[i].value()) != 0.0) { return false; }
+		}
+		if ((m_device.m_tables = device::create(m_circuit)) == nullptr) { return false; }
+	}
+	if (m_device.m_revision != m_revision) {
+		m_device.m_revision = 0;
+		if (!device::set_tolerances(m_device.m_tables, m_tolerances.data(), m_seed)) { return false; }
+		m_device.m_revision = m_revision;
+	}
+	return device::input_impedance(m_device.m_tables, f, n, first, trials, zin);
+}
+
+void
+monte_carlo::run(const double *f, const std::size_t n, const std::uint64_t first,
+	const std::size_t trials, cxd_t *zin) const {
+	if (device::use(m_backend, trials * n) && device_run(f, n, first, trials, zin)) { return; }
+	std::vector<double> scales(m_circuit.size() * SWEEP_BLOCK);
+	for (std::size_t t = 0; t < trials; t += SWEEP_BLOCK) {
+		batch(f, n, first + t, std::min(SWEEP_BLOCK, trials - t), scales.data(), zin + t * n);
+	}
+}
+
+void
+monte_carlo::run(thread_pool &pool, const double *f, const std::size_t n, const std::uint64_t first,
+	const std::size_t trials, cxd_t *zin) const {
+	if (device::use(m_backend, trials * n) && device_run(f, n, first, trials, zin)) { return; }
+	const std::size_t tasks = (trials + SWEEP_CHUNK - 1) / SWEEP_CHUNK;
+	pool.parallel_for(tasks, [&](std::size_t task) {
+		const std::size_t t = task * SWEEP_CHUNK;
+		const std::size_t count = std::min(SWEEP_CHUNK, trials - t);
+		std::vector<double> scales(m_circuit.size() * SWEEP_BLOCK);
+		for (std::size_t b = 0; b < count; b += SWEEP_BLOCK) {
+			batch(f, n, first + t + b, std::min(SWEEP_BLOCK, count - b), scales.data(), zin + (t + b) * n);
+		}
+	});
+}
+
+double
+monte_carlo::yield(thread_pool &pool, const double *f, const std::size_t n, const std::uint64_t trials,
+	const std::function<bool(const cxd_t *zin, const std::size_t n)> &pass) const {
+	if (trials == 0) { return 0.0; }
+	std::atomic<std::uint64_t> passed{0};
+	// Device runs of DEVICE_CHUNK_POINTS points, the pool checks each one while
+	// the rest, if the device gives up, continues on the CPU
+	std::uint64_t done = 0;
+	if (device::use(m_backend, trials * n)) {
+		const std::size_t rows = std::max<std::size_t>(1, DEVICE_CHUNK_POINTS / std::max<std::size_t>(n, 1));
+		std::vector<cxd_t> zin(std::min<std::uint64_t>(rows, trials) * n);
+		while (done < trials) {
+			const std::size_t count = std::min<std::uint64_t>(rows, trials - done);
+			if (!device_run(f, n, done, count, zin.data())) { break; }
+			const std::size_t tasks = (count + SWEEP_BLOCK - 1) / SWEEP_BLOCK;
+			pool.parallel_for(tasks, [&](std::size_t task) {
+				std::uint64_t ok = 0;
+				for (std::size_t i = task * SWEEP_BLOCK; i < std::min(count, (task + 1) * SWEEP_BLOCK); i++) {
+					if (pass(zin.data() + i * n, n)) { ok++; }
+				}
+				passed.fetch_add(ok, std::memory_order_relaxed);
+			});
+			done += count;
+		}
+	}
+	const std::size_t tasks = (trials - done + SWEEP_BLOCK - 1) / SWEEP_BLOCK;
+	pool.parallel_for(tasks, [&](std::size_t task) {
+		const std::uint64_t t = done + task * SWEEP_BLOCK;
+		const std::size_t count = std::min<std::uint64_t>(SWEEP_BLOCK, trials - t);
+		std::vector<double> scales(m_circuit.size() * SWEEP_BLOCK);
+		std::vector<cxd_t> zin(count * n);
+		batch(f, n, t, count, scales.data(), zin.data());
+		std::uint64_t ok = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			if (pass(zin.data() + i * n, n)) { ok++; }
+		}
+		passed.fetch_add(ok, std::memory_order_relaxed);
+	});
+	return static_cast<double>(passed.load()) / static_cast<double>(trials);
+}
+
+}
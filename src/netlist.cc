@@ -0,0 +1,156 @@
+#include "../include/casport_netlist.h"
+#include "text.h"
+
+namespace casport{
+
+// Number with an optional SI suffix
+static bool
+to_value(const std::string_view token, double &v) {
+	std::string_view rest;
+	if (!text::to_number(token, v, rest)) { return false; }
+	if (rest.empty()) { return true; }
+	if (rest.size() != 1) { return false; }
+	switch (rest[0]) {
+	case 'f': v *= 1.0e-15; return true;
+	case 'p': v *= 1.0e-12; return true;
+	case 'n': v *= 1.0e-9; return true;
+	case 'u': v *= 1.0e-6; return true;
+	case 'm': v *= 1.0e-3; return true;
+	case 'k': v *= 1.0e3; return true;
+	case 'M': v *= 1.0e6; return true;
+	case 'G': v *= 1.0e9; return true;
+	case 'T': v *= 1.0e12; return true;
+	}
+	return false;
+}
+
+static inline bool
+next_token(std::string_view &line, std::string_view &token) {
+	return text::next_token(line, token, '#');
+}
+
+static bool
+next_number(std::string_view &line, double &v) {
+	std::string_view token;
+	return next_token(line, token) && to_value(token, v);
+}
+
+static bool
+next_mount(std::string_view &line, mount_t &m) {
+	std::string_view token;
+	if (!next_token(line, token)) { return false; }
+	if (text::is_keyword(token, "series")) { m = SERIES; return true; }
+	if (text::is_keyword(token, "shunt")) { m = SHUNT; return true; }
+	return false;
+}
+
+static bool
+to_component(const std::string_view token, element_t &e) {
+	static const struct { const char *name; element_t e; } names[] = {
+		{ "trl", TRL }, { "cap", CAP }, { "ind", IND }, { "res", RES }, { "ocs", OCS }, { "scs", SCS }
+	};
+	for (const auto &n : names) {
+		if (text::is_keyword(token, n.name)) { e = n.e; return true; }
+	}
+	return false;
+}
+
+// Runs over every circuit of the netlist, emit(z0, f, chain) is called when one is complete
+template<typename Emit>
+static netlist_error_t
+parse(const std::string_view netlist, std::pmr::memory_resource *mr, Emit emit) {
+	elements_vec_t chain(mr);
+	chain.reserve(16);
+	double z0 = 50.0, f = DEFAULT_FREQUENCY;
+	bool open = false; // statements since the last end
+	std::size_t line_no = 0;
+	std::string_view rest = netlist, line;
+	while (text::next_line(rest, line)) {
+		line_no++;
+
+		std::string_view token;
+		if (!next_token(line, token)) { continue; }
+		if (text::is_keyword(token, "end")) {
+			if (chain.empty()) { return netlist_error_t{ line_no, "circuit has no elements" }; }
+			if (!emit(z0, f, chain)) { return netlist_error_t{ line_no, "more than one circuit" }; }
+			if (next_token(line, token)) { return netlist_error_t{ line_no, "unexpected token" }; }
+			chain.clear();
+			z0 = 50.0;
+			f = DEFAULT_FREQUENCY;
+			open = false;
+			continue;
+		}
+		open = true;
+		if (text::is_keyword(token, "z0")) {
+			if (!next_number(line, z0)) { return netlist_error_t{ line_no, "expected load impedance" }; }
+		} else if (text::is_keyword(token, "f")) {
+			if (!next_number(line, f) || !(f > 0.0)) { return netlist_error_t{ line_no, "expected positive frequency" }; }
+		} else {
+			element_t e;
+			mount_t m;
+			double v, z, alpha = 0.0;
+			if (!to_component(token, e)) { return netlist_error_t{ line_no, "unknown statement" }; }
+			switch (e) {
+			case TRL:
+				if (!next_number(line, v) || !next_number(line, z)) {
+					return netlist_error_t{ line_no, "expected line length and impedance" };
+				}
+				if (next_token(line, token) && !to_value(token, alpha)) {
+					return netlist_error_t{ line_no, "expected line loss" };
+				}
+				if (!(z > 0.0)) { return netlist_error_t{ line_no, "line impedance must be positive" }; }
+				chain.push_back(element(v, z, alpha));
+				break;
+			case OCS:
+			case SCS:
+				if (!next_mount(line, m)) { return netlist_error_t{ line_no, "expected SERIES or SHUNT" }; }
+				if (!next_number(line, v) || !next_number(line, z)) {
+					return netlist_error_t{ line_no, "expected stub length and impedance" };
+				}
+				if (!(z > 0.0)) { return netlist_error_t{ line_no, "stub impedance must be positive" }; }
+				chain.push_back(element(e, m, v, z));
+				break;
+			case CAP:
+			case IND:
+			case RES:
+				if (!next_mount(line, m)) { return netlist_error_t{ line_no, "expected SERIES or SHUNT" }; }
+				if (!next_number(line, v)) { return netlist_error_t{ line_no, "expected value" }; }
+				if (!(v > 0.0)) { return netlist_error_t{ line_no, "value must be positive" }; }
+				chain.push_back(element(e, m, v));
+				break;
+			case SUB:
+				return netlist_error_t{ line_no, "unknown statement" };
+			}
+		}
+		if (next_token(line, token)) { return netlist_error_t{ line_no, "unexpected token" }; }
+	}
+	if (open && chain.empty()) { return netlist_error_t{ line_no, "circuit has no elements" }; }
+	if (open && !emit(z0, f, chain)) { return netlist_error_t{ line_no, "more than one circuit" }; }
+	return netlist_error_t{ 0, nullptr };
+}
+
+netlist_error_t
+parse_netlist(const std::string_view text, circuit &c) {
+	bool done = false;
+	const netlist_error_t r = parse(text, std::pmr::get_default_resource(),
+		[&](const double z0, const double f, const elements_vec_t &chain) {
+		if (done) { return false; }
+		c = circuit(z0, chain.data(), chain.size());
+		c.set_frequency(f);
+		done = true;
+		return true;
+	});
+	if (r.message == nullptr && !done) { return netlist_error_t{ 1, "empty netlist" }; }
+	return r;
+}
+
+netlist_error_t
+parse_netlists(const std::string_view text, std::vector<circuit> &circuits, std::pmr::memory_resource *mr) {
+	return parse(text, mr, [&](const double z0, const double f, const elements_vec_t &chain) {
+		circuits.emplace_back(z0, chain.data(), chain.size(), mr);
+		circuits.back().set_frequency(f);
+		return true;
+	});
+}
+
+}
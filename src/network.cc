@@ -0,0 +1,50 @@
+#include "../include/casport_network.h"
+#include "kernels.h"
+#include <algorithm>
+
+namespace casport{
+
+static_assert(int(kernels::CONVERT_S) == S_PARAMETERS && int(kernels::CONVERT_Z) == Z_PARAMETERS &&
+	int(kernels::CONVERT_Y) == Y_PARAMETERS && int(kernels::CONVERT_T) == T_PARAMETERS, "kernel conversion codes");
+
+// Up to SWEEP_BLOCK lanes, p and r are distinct locals
+static void
+convert_block(const abcd_soa &p, const std::size_t m, const parameters_t to, const double z_ref, abcd_soa &r) {
+	if (to == ABCD_PARAMETERS) {
+		r = p;
+		return;
+	}
+	const double *const pp[8] = { p.a_re, p.a_im, p.b_re, p.b_im, p.c_re, p.c_im, p.d_re, p.d_im };
+	double *const rp[8] = { r.a_re, r.a_im, r.b_re, r.b_im, r.c_re, r.c_im, r.d_re, r.d_im };
+	kernels::convert(pp, m, to, z_ref, rp);
+}
+
+// Blocks are staged through abcd_soa, so out may be abcd itself
+void
+convert(const network_soa_t &abcd, const std::size_t n, const parameters_t to, const double z_ref,
+	const network_soa_t &out) {
+	abcd_soa p, r;
+	double *p_re[4] = { p.a_re, p.b_re, p.c_re, p.d_re }, *p_im[4] = { p.a_im, p.b_im, p.c_im, p.d_im };
+	const double *r_re[4] = { r.a_re, r.b_re, r.c_re, r.d_re }, *r_im[4] = { r.a_im, r.b_im, r.c_im, r.d_im };
+	for (std::size_t k = 0; k < n; k += SWEEP_BLOCK) {
+		const std::size_t m = std::min(SWEEP_BLOCK, n - k);
+		for (std::size_t j = 0; j < 4; j++) {
+			std::copy(abcd.re[j] + k, abcd.re[j] + k + m, p_re[j]);
+			std::copy(abcd.im[j] + k, abcd.im[j] + k + m, p_im[j]);
+		}
+		convert_block(p, m, to, z_ref, r);
+		for (std::size_t j = 0; j < 4; j++) {
+			std::copy(r_re[j], r_re[j] + m, out.re[j] + k);
+			std::copy(r_im[j], r_im[j] + m, out.im[j] + k);
+		}
+	}
+}
+
+void
+sweep(const circuit &c, const double *f, const std::size_t n, const parameters_t to, const double z_ref,
+	const network_soa_t &out) {
+	c.abcd(f, n, out);
+	convert(out, n, to, z_ref, out);
+}
+
+}
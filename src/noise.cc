@@ -0,0 +1,227 @@
+#include "../include/casport.h"
+#include "kernels.h"
+#include <algorithm>
+
+// Noise of the cascade in the ABCD (chain) correlation form of Hillbrand and
+// Russer. Every two-port is noiseless behind a series voltage source e and a
+// shunt current source i at its input, with the Hermitian correlation matrix
+// C = [<ee*> <ei*>; <ie*> <ii*>]. Putting E in front of a cascade with C gives
+// C' = C_E + E C E^H. Entries are kept divided by 4 k NOISE_T0, in ohm, S and 1.
+namespace casport{
+
+namespace {
+// Lanes of C, c21 = conj(c12)
+struct noise_soa {
+	alignas(64) double c11[SWEEP_BLOCK];
+	alignas(64) double c22[SWEEP_BLOCK];
+	alignas(64) double c12_re[SWEEP_BLOCK];
+	alignas(64) double c12_im[SWEEP_BLOCK];
+	void zero(const std::size_t n) {
+		std::fill(c11, c11 + n, 0.0);
+		std::fill(c22, c22 + n, 0.0);
+		std::fill(c12_re, c12_re + n, 0.0);
+		std::fill(c12_im, c12_im + n, 0.0);
+	}
+};
+}
+
+// C' = E C E^H for a series element, E = [1 z; 0 1], plus its source ratio Re z
+static void
+noise_series(noise_soa &c, const double *x_re, const double *x_im, const double ratio, const std::size_t n) {
+	for (std::size_t i = 0; i < n; i++) {
+		// c11 += 2 Re(z conj(c12)) + |z|^2 c22, c12 += z c22
+		c.c11[i] += 2.0 * (x_re[i] * c.c12_re[i] + x_im[i] * c.c12_im[i]) +
+			(x_re[i] * x_re[i] + x_im[i] * x_im[i]) * c.c22[i] + ratio * x_re[i];
+		c.c12_re[i] += x_re[i] * c.c22[i];
+		c.c12_im[i] += x_im[i] * c.c22[i];
+	}
+}
+
+// E = [1 0; y 1], plus the source ratio Re y
+static void
+noise_shunt(noise_soa &c, const double *x_re, const double *x_im, const double ratio, const std::size_t n) {
+	for (std::size_t i = 0; i < n; i++) {
+		// c22 += 2 Re(y c12) + |y|^2 c11, c12 += conj(y) c11
+		c.c22[i] += 2.0 * (x_re[i] * c.c12_re[i] - x_im[i] * c.c12_im[i]) +
+			(x_re[i] * x_re[i] + x_im[i] * x_im[i]) * c.c11[i] + ratio * x_re[i];
+		c.c12_re[i] += x_re[i] * c.c11[i];
+		c.c12_im[i] -= x_im[i] * c.c11[i];
+	}
+}
+
+// Correlation of a passive two-port E = [p q; r s] at uniform temperature
+// (Bosma), ratio Re(Y) taken to the chain form, or from Re(Z) when q = 0
+static void
+noise_passive(const cxd_t p, const cxd_t q, const cxd_t r, const cxd_t s, const double ratio,
+	double &c11, cxd_t &c12, double &c22) {
+	if (std::abs(q) > 0.0) {
+		const cxd_t y12 = (q * r - p * s) / q, y21 = -1.0 / q;
+		const double h11 = ratio * std::real(s / q), h22 = ratio * std::real(p / q);
+		const cxd_t h12 = 0.5 * ratio * (y12 + std::conj(y21));
+		c11 = std::norm(q) * h22;
+		c12 = q * (std::conj(h12) + h22 * std::conj(s));
+		c22 = h11 + 2.0 * std::real(h12 * std::conj(s)) + std::norm(s) * h22;
+	} else if (std::abs(r) > 0.0) {
+		const cxd_t z12 = (p * s - q * r) / r, z21 = 1.0 / r;
+		const double h11 = ratio * std::real(p / r), h22 = ratio * std::real(s / r);
+		const cxd_t h12 = 0.5 * ratio * (z12 + std::conj(z21));
+		c11 = h11 - 2.0 * std::real(h12 * std::conj(p)) + std::norm(p) * h22;
+		c12 = -std::conj(r) * (h12 - p * h22);
+		c22 = std::norm(r) * h22;
+	} else {
+		c11 = 0.0;
+		c12 = 0.0;
+		c22 = 0.0;
+	}
+}
+
+// C' = E C E^H for a two-port E = [p q; r s], m = { p_re, p_im, q_re, q_im, r_re, r_im, s_re, s_im }
+static void
+noise_two_port(noise_soa &c, const double *const *m, const std::size_t n) {
+	const double *p_re = m[0], *p_im = m[1], *q_re = m[2], *q_im = m[3];
+	const double *r_re = m[4], *r_im = m[5], *s_re = m[6], *s_im = m[7];
+	for (std::size_t i = 0; i < n; i++) {
+		const double a11 = c.c11[i], a22 = c.c22[i], a_re = c.c12_re[i], a_im = c.c12_im[i];
+		// Products x conj(y) of the rows' entries
+		const double pq_re = p_re[i] * q_re[i] + p_im[i] * q_im[i], pq_im = p_im[i] * q_re[i] - p_re[i] * q_im[i];
+		const double rs_re = r_re[i] * s_re[i] + r_im[i] * s_im[i], rs_im = r_im[i] * s_re[i] - r_re[i] * s_im[i];
+		const double pr_re = p_re[i] * r_re[i] + p_im[i] * r_im[i], pr_im = p_im[i] * r_re[i] - p_re[i] * r_im[i];
+		const double ps_re = p_re[i] * s_re[i] + p_im[i] * s_im[i], ps_im = p_im[i] * s_re[i] - p_re[i] * s_im[i];
+		const double qr_re = q_re[i] * r_re[i] + q_im[i] * r_im[i], qr_im = q_im[i] * r_re[i] - q_re[i] * r_im[i];
+		const double qs_re = q_re[i] * s_re[i] + q_im[i] * s_im[i], qs_im = q_im[i] * s_re[i] - q_re[i] * s_im[i];
+		// c12 = p r* a11 + p s* a12 + q r* conj(a12) + q s* a22
+		c.c12_re[i] = pr_re * a11 + ps_re * a_re - ps_im * a_im + qr_re * a_re + qr_im * a_im + qs_re * a22;
+		c.c12_im[i] = pr_im * a11 + ps_re * a_im + ps_im * a_re - qr_re * a_im + qr_im * a_re + qs_im * a22;
+		c.c11[i] = (p_re[i] * p_re[i] + p_im[i] * p_im[i]) * a11 + (q_re[i] * q_re[i] + q_im[i] * q_im[i]) * a22 +
+			2.0 * (pq_re * a_re - pq_im * a_im);
+		c.c22[i] = (r_re[i] * r_re[i] + r_im[i] * r_im[i]) * a11 + (s_re[i] * s_re[i] + s_im[i] * s_im[i]) * a22 +
+			2.0 * (rs_re * a_re - rs_im * a_im);
+	}
+}
+
+// Line E = [u z0 v; v / z0 u], u = cosh(gamma l) = (ch c, sh s), v = sinh(gamma l) = (sh c, ch s)
+// as kernels::cline. A line's own noise does not depend on its phase,
+// C_E = ratio [z0 sh ch, sh^2; sh^2, sh ch / z0].
+static void
+noise_line(noise_soa &c, const double *cos_t, const double *sin_t, const double al, const double z0,
+	const double ratio, const std::size_t n) {
+	const double ch = std::cosh(al), sh = std::sinh(al), y0 = 1.0 / z0;
+	const double e11 = ratio * z0 * sh * ch, e22 = ratio * y0 * sh * ch, e12 = ratio * sh * sh;
+	for (std::size_t i = 0; i < n; i++) {
+		const double u_re = ch * cos_t[i], u_im = sh * sin_t[i], v_re = sh * cos_t[i], v_im = ch * sin_t[i];
+		const double a11 = c.c11[i], a22 = c.c22[i], a_re = c.c12_re[i], a_im = c.c12_im[i];
+		// w = u conj(v)
+		const double nu = u_re * u_re + u_im * u_im, nv = v_re * v_re + v_im * v_im;
+		const double w_re = u_re * v_re + u_im * v_im, w_im = u_im * v_re - u_re * v_im;
+		c.c11[i] = nu * a11 + z0 * z0 * nv * a22 + 2.0 * z0 * (w_re * a_re - w_im * a_im) + e11;
+		c.c22[i] = y0 * y0 * nv * a11 + nu * a22 + 2.0 * y0 * (w_re * a_re + w_im * a_im) + e22;
+		c.c12_re[i] = y0 * w_re * a11 + (nu + nv) * a_re + z0 * w_re * a22 + e12;
+		c.c12_im[i] = y0 * w_im * a11 + (nu - nv) * a_im - z0 * w_im * a22;
+	}
+}
+
+// One walk per block carries the chain product and C together, the load (last
+// element) is applied to the product only. The product lanes are the ones
+// circuit::chain computes, element by element, with the same shared tables.
+void
+circuit::noise_figure(const double *f, const std::size_t n, const cxd_t z_source, double *nf, cxd_t *zin,
+	const double temperature) const {
+	if (m_elements.empty()) {
+		for (std::size_t i = 0; i < n; i++) {
+			nf[i] = std::nan("");
+			if (zin != nullptr) { zin[i] = cxd_t(std::nan(""), std::nan("")); }
+		}
+		return;
+	}
+	const std::size_t n_el = m_elements.size() - 1;
+	const double ratio = temperature / NOISE_T0;
+	std::vector<double> lengths;
+	std::vector<std::size_t> slot(n_el);
+	for (std::size_t i = 0; i < n_el; i++) {
+		if (!m_elements[i].is_line() && !m_elements[i].is_stub()) { continue; }
+		const double l = std::real(m_elements[i].value());
+		slot[i] = std::find(lengths.begin(), lengths.end(), l) - lengths.begin();
+		if (slot[i] == lengths.size()) { lengths.push_back(l); }
+	}
+	std::vector<double> trig(2 * lengths.size() * SWEEP_BLOCK); // cos then sin per length
+	std::vector<subcircuit::table_t> tables(n_el);
+	for (std::size_t i = 0; i < n_el; i++) {
+		if (!m_elements[i].is_block()) { continue; }
+		std::size_t j = 0;
+		while (j < i && m_elements[j].block() != m_elements[i].block()) { j++; }
+		tables[i] = (j < i) ? tables[j] : m_elements[i].block()->sweep(f, n);
+	}
+
+	abcd_soa abcd, load;
+	noise_soa c;
+	alignas(64) double theta[SWEEP_BLOCK], f_rec[SWEEP_BLOCK], x_re[SWEEP_BLOCK], x_im[SWEEP_BLOCK];
+	const double rs = std::real(z_source);
+	for (std::size_t k = 0; k < n; k += SWEEP_BLOCK) {
+		const std::size_t m = std::min(SWEEP_BLOCK, n - k);
+		for (std::size_t i = 0; i < m; i++) { f_rec[i] = 1.0 / f[k + i]; }
+		for (std::size_t j = 0; j < lengths.size(); j++) {
+			const double p = detail::phase_per_hz(lengths[j]);
+			for (std::size_t i = 0; i < m; i++) { theta[i] = p * f[k + i]; }
+			double *t = trig.data() + 2 * j * SWEEP_BLOCK;
+			kernels::sincos(theta, t + SWEEP_BLOCK, t, m);
+		}
+		abcd.identity(m);
+		c.zero(m);
+		for (std::size_t i = n_el; i-- > 0;) {
+			const element &e = m_elements[i];
+			if (e.is_block()) {
+				const double *t = tables[i]->data() + k;
+				const double *r[8] = { t, t + n, t + 2 * n, t + 3 * n, t + 4 * n, t + 5 * n, t + 6 * n, t + 7 * n };
+				noise_two_port(c, r, m);
+				for (std::size_t j = 0; j < m; j++) {
+					double e11, e22;
+					cxd_t e12;
+					noise_passive(cxd_t(r[0][j], r[1][j]), cxd_t(r[2][j], r[3][j]), cxd_t(r[4][j], r[5][j]),
+						cxd_t(r[6][j], r[7][j]), ratio, e11, e12, e22);
+					c.c11[j] += e11;
+					c.c22[j] += e22;
+					c.c12_re[j] += std::real(e12);
+					c.c12_im[j] += std::imag(e12);
+				}
+				e.flma_two_port(abcd, r, m);
+			} else if (e.is_line()) {
+				const double *cos_t = trig.data() + 2 * slot[i] * SWEEP_BLOCK, *sin_t = cos_t + SWEEP_BLOCK;
+				noise_line(c, cos_t, sin_t, e.alpha() * std::real(e.value()), e.z0(), ratio, m);
+				e.flma_trl(abcd, cos_t, sin_t, m);
+			} else {
+				if (e.is_constant()) {
+					const cxd_t x = e.immittance(0.0);
+					std::fill(x_re, x_re + m, std::real(x));
+					std::fill(x_im, x_im + m, std::imag(x));
+				} else {
+					const double *t = e.is_stub() ? trig.data() + 2 * slot[i] * SWEEP_BLOCK : f_rec;
+					e.immittance(f + k, f_rec, t, t + SWEEP_BLOCK, m, x_re, x_im);
+				}
+				if (e.is_shunt()) {
+					noise_shunt(c, x_re, x_im, ratio, m);
+				} else {
+					noise_series(c, x_re, x_im, ratio, m);
+				}
+				e.flma(abcd, x_re, x_im, m);
+			}
+		}
+		// F = 1 + (c11 + 2 Re(c12 conj(zs)) + |zs|^2 c22) / Re(zs)
+		for (std::size_t i = 0; i < m; i++) {
+			const double added = c.c11[i] + 2.0 * (c.c12_re[i] * std::real(z_source) + c.c12_im[i] * std::imag(z_source)) +
+				std::norm(z_source) * c.c22[i];
+			nf[k + i] = 10.0 * std::log10(1.0 + added / rs);
+		}
+		if (zin == nullptr) { continue; }
+		// First column of the product with the load, A' = A l_a + B l_c, C' = C l_a + D l_c
+		load.identity(m);
+		m_elements.back().flma(load, f + k, m);
+		for (std::size_t i = 0; i < m; i++) {
+			const cxd_t la(load.a_re[i], load.a_im[i]), lc(load.c_re[i], load.c_im[i]);
+			const cxd_t a = cxd_t(abcd.a_re[i], abcd.a_im[i]) * la + cxd_t(abcd.b_re[i], abcd.b_im[i]) * lc;
+			const cxd_t cc = cxd_t(abcd.c_re[i], abcd.c_im[i]) * la + cxd_t(abcd.d_re[i], abcd.d_im[i]) * lc;
+			zin[k + i] = a / cc;
+		}
+	}
+}
+
+}
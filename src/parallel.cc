@@ -0,0 +1,152 @@
+#include "../include/casport_parallel.h"
+#include <algorithm>
+
+namespace casport{
+
+namespace {
+thread_local bool t_in_pool = false;
+}
+
+thread_pool::thread_pool(const std::size_t threads) :
+	m_fn(nullptr), m_generation(0), m_active(0), m_stop(false) {
+	std::size_t n = threads;
+	if (n == 0) { n = std::max(1u, std::thread::hardware_concurrency()); }
+	m_ranges.reset(new range[n]);
+	for (std::size_t i = 0; i < n; i++) { m_ranges[i].begin = m_ranges[i].end = 0; }
+	m_threads.reserve(n - 1);
+	for (std::size_t i = 0; i + 1 < n; i++) {
+		m_threads.emplace_back(&thread_pool::worker, this, i);
+	}
+}
+
+thread_pool::~thread_pool() {
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto &t : m_threads) { t.join(); }
+}
+
+void
+thread_pool::worker(const std::size_t id) {
+	t_in_pool = true;
+	std::uint64_t seen = 0;
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (true) {
+		m_wake.wait(lock, [&]{ return m_stop || m_generation != seen; });
+		if (m_stop) { return; }
+		seen = m_generation;
+		lock.unlock();
+		drain(id);
+		lock.lock();
+		if (--m_active == 0) { m_done.notify_one(); }
+	}
+}
+
+// Take from the front of our own range, otherwise steal the back half of another
+bool
+thread_pool::next(const std::size_t id, std::size_t &task) {
+	{
+		range &own = m_ranges[id];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (own.begin < own.end) {
+			task = own.begin++;
+			return true;
+		}
+	}
+	const std::size_t n = size();
+	for (std::size_t k = 1; k < n; k++) {
+		range &victim = m_ranges[(id + k) % n];
+		std::size_t begin, end;
+		{
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (victim.begin >= victim.end) { continue; }
+			end = victim.end;
+			begin = end - (end - victim.begin + 1) / 2;
+			victim.end = begin;
+		}
+		range &own = m_ranges[id];
+		std::lock_guard<std::mutex> guard(own.lock);
+		task = begin;
+		own.begin = begin + 1;
+		own.end = end;
+		return true;
+	}
+	return false;
+}
+
+void
+thread_pool::drain(const std::size_t id) {
+	std::size_t task;
+	while (next(id, task)) {
+		try {
+			(*m_fn)(task);
+		} catch (...) {
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (!m_error) { m_error = std::current_exception(); }
+		}
+	}
+}
+
+void
+thread_pool::parallel_for(const std::size_t n, const std::function<void(std::size_t)> &fn) {
+	if (n == 0) { return; }
+	if (t_in_pool || m_threads.empty() || n == 1) {
+		for (std::size_t i = 0; i < n; i++) { fn(i); }
+		return;
+	}
+	std::lock_guard<std::mutex> run(m_run);
+	const std::size_t threads = size();
+	for (std::size_t i = 0; i < threads; i++) {
+		std::lock_guard<std::mutex> guard(m_ranges[i].lock);
+		m_ranges[i].begin = n * i / threads;
+		m_ranges[i].end = n * (i + 1) / threads;
+	}
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_fn = &fn;
+		m_error = nullptr;
+		m_active = m_threads.size();
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	t_in_pool = true;
+	drain(threads - 1);
+	t_in_pool = false;
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_done.wait(lock, [&]{ return m_active == 0; });
+	m_fn = nullptr;
+	if (m_error) {
+		std::exception_ptr error = m_error;
+		m_error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void
+parallel_input_impedance(thread_pool &pool, const circuit &c,
+	const double *f, const std::size_t n, cxd_t *zin) {
+	if (c.m_memo.recall(c.m_revision, f, n, zin)) { return; }
+	const std::size_t tasks = (n + SWEEP_CHUNK - 1) / SWEEP_CHUNK;
+	pool.parallel_for(tasks, [&](std::size_t t) {
+		const std::size_t k = t * SWEEP_CHUNK;
+		c.sweep(f + k, std::min(SWEEP_CHUNK, n - k), zin + k);
+	});
+	c.m_memo.store(c.m_revision, f, n, zin);
+}
+
+void
+parallel_input_impedance(thread_pool &pool, const circuit *c, const std::size_t n_circuits,
+	const double *f, const std::size_t n, cxd_t *zin) {
+	const std::size_t chunks = (n + SWEEP_CHUNK - 1) / SWEEP_CHUNK;
+	pool.parallel_for(n_circuits * chunks, [&](std::size_t t) {
+		const std::size_t i = t / chunks;
+		const std::size_t k = (t % chunks) * SWEEP_CHUNK;
+		c[i].sweep(f + k, std::min(SWEEP_CHUNK, n - k), zin + i * n + k);
+	});
+}
+
+}
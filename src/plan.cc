@@ -0,0 +1,177 @@
+#include "../include/casport.h"
+#include "kernels.h"
+#include <algorithm>
+
+namespace casport{
+
+static inline void
+mul2(cxd_t *r, const cxd_t *x, const cxd_t *y) {
+	const cxd_t t[4] = { x[0] * y[0] + x[1] * y[2], x[0] * y[1] + x[1] * y[3],
+						 x[2] * y[0] + x[3] * y[2], x[2] * y[1] + x[3] * y[3] };
+	std::copy(t, t + 4, r);
+}
+
+// Row update of every lane with immittance x (broadcast) or x[i]
+static inline void
+row(abcd_soa &abcd, const mount_t mount, const cxd_t x, const std::size_t n) {
+	if (mount == SHUNT) {
+		kernels::cfma(abcd.c_re, abcd.c_im, abcd.a_re, abcd.a_im, std::real(x), std::imag(x), n);
+		kernels::cfma(abcd.d_re, abcd.d_im, abcd.b_re, abcd.b_im, std::real(x), std::imag(x), n);
+	} else {
+		kernels::cfma(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, std::real(x), std::imag(x), n);
+		kernels::cfma(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, std::real(x), std::imag(x), n);
+	}
+}
+
+static inline void
+row(abcd_soa &abcd, const mount_t mount, const double *x_re, const double *x_im, const std::size_t n) {
+	if (mount == SHUNT) {
+		kernels::cfma(abcd.c_re, abcd.c_im, abcd.a_re, abcd.a_im, x_re, x_im, n);
+		kernels::cfma(abcd.d_re, abcd.d_im, abcd.b_re, abcd.b_im, x_re, x_im, n);
+	} else {
+		kernels::cfma(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, x_re, x_im, n);
+		kernels::cfma(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, x_re, x_im, n);
+	}
+}
+
+void
+plan::push_row(const mount_t mount, const cxd_t x, const elements_vec_t &terms) {
+	step s;
+	s.kind = ROW;
+	s.mount = mount;
+	s.x = x;
+	s.first = m_terms.size();
+	s.count = terms.size();
+	m_terms.insert(m_terms.end(), terms.begin(), terms.end());
+	m_steps.push_back(s);
+}
+
+plan
+circuit::compile() const {
+	plan p;
+	// Fuse runs of equal mount
+	std::size_t i = 0;
+	elements_vec_t terms;
+	while (i < m_elements.size()) {
+		if (m_elements[i].is_two_port()) {
+			plan::step s;
+			s.kind = plan::LINE;
+			s.first = p.m_terms.size();
+			s.count = 1;
+			p.m_terms.push_back(m_elements[i++]);
+			p.m_steps.push_back(s);
+			continue;
+		}
+		const mount_t mount = m_elements[i].mount();
+		cxd_t x = cxd_t(0.0, 0.0);
+		terms.clear();
+		for (; i < m_elements.size() && !m_elements[i].is_two_port() && m_elements[i].mount() == mount; i++) {
+			if (m_elements[i].is_constant()) {
+				x += m_elements[i].immittance(0.0);
+			} else {
+				terms.push_back(m_elements[i]);
+			}
+		}
+		p.push_row(mount, x, terms);
+	}
+
+	// Fold runs of constant rows into one matrix
+	std::vector<plan::step> steps;
+	for (std::size_t k = 0; k < p.m_steps.size();) {
+		std::size_t j = k;
+		while (j < p.m_steps.size() && p.m_steps[j].kind == plan::ROW && p.m_steps[j].count == 0) { j++; }
+		if (j - k < 2) {
+			steps.push_back(p.m_steps[k]);
+			k++;
+			continue;
+		}
+		plan::step s;
+		s.kind = plan::MATRIX;
+		s.m[0] = s.m[3] = cxd_t(1.0, 0.0);
+		s.m[1] = s.m[2] = cxd_t(0.0, 0.0);
+		for (; k < j; k++) {
+			cxd_t r[4] = { cxd_t(1.0, 0.0), cxd_t(0.0, 0.0), cxd_t(0.0, 0.0), cxd_t(1.0, 0.0) };
+			r[(p.m_steps[k].mount == SHUNT) ? 2 : 1] = p.m_steps[k].x;
+			mul2(s.m, s.m, r);
+		}
+		steps.push_back(s);
+	}
+	p.m_steps.swap(steps);
+	return p;
+}
+
+cxd_t
+plan::input_impedance(const double f) const {
+	if (m_steps.empty()) { return cxd_t(std::nan(""), std::nan("") ); }
+	cxd_t abcd[4] = { cxd_t(1.0, 0.0), cxd_t(0.0, 0.0),
+					  cxd_t(0.0, 0.0), cxd_t(1.0, 0.0) };
+	for (auto s = m_steps.crbegin(); s != m_steps.crend(); s++) {
+		if (s->kind == MATRIX) {
+			mul2(abcd, s->m, abcd);
+			continue;
+		}
+		if (s->kind == LINE) {
+			cxd_t m[4];
+			m_terms[s->first].abcd(f, m);
+			mul2(abcd, m, abcd);
+			continue;
+		}
+		cxd_t x = s->x;
+		for (std::size_t t = 0; t < s->count; t++) { x += m_terms[s->first + t].immittance(f); }
+		if (s->mount == SHUNT) {
+			detail::flma<SHUNT>(x, abcd);
+		} else {
+			detail::flma<SERIES>(x, abcd);
+		}
+	}
+	return abcd[0] / abcd[2];
+}
+
+void
+plan::input_impedance(const double *f, const std::size_t n, cxd_t *zin) const {
+	if (m_steps.empty()) {
+		for (std::size_t i = 0; i < n; i++) { zin[i] = cxd_t(std::nan(""), std::nan("")); }
+		return;
+	}
+
+	abcd_soa abcd;
+	alignas(64) double x_re[SWEEP_BLOCK], x_im[SWEEP_BLOCK];
+	alignas(64) double t_re[SWEEP_BLOCK], t_im[SWEEP_BLOCK];
+	for (std::size_t k = 0; k < n; k += SWEEP_BLOCK) {
+		const std::size_t m = std::min(SWEEP_BLOCK, n - k);
+		abcd.identity(m);
+		for (auto s = m_steps.crbegin(); s != m_steps.crend(); s++) {
+			if (s->kind == MATRIX) {
+				const double *mm = reinterpret_cast<const double *>(s->m);
+				kernels::crot(abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, mm, m);
+				kernels::crot(abcd.b_re, abcd.b_im, abcd.d_re, abcd.d_im, mm, m);
+				continue;
+			}
+			if (s->kind == LINE) {
+				m_terms[s->first].flma(abcd, f + k, m);
+				continue;
+			}
+			if (s->count == 0) {
+				row(abcd, s->mount, s->x, m);
+				continue;
+			}
+			// Summed table of the frequency dependent terms plus the constant part
+			std::fill(x_re, x_re + m, std::real(s->x));
+			std::fill(x_im, x_im + m, std::imag(s->x));
+			for (std::size_t t = 0; t < s->count; t++) {
+				m_terms[s->first + t].immittance(f + k, m, t_re, t_im);
+				for (std::size_t i = 0; i < m; i++) {
+					x_re[i] += t_re[i];
+					x_im[i] += t_im[i];
+				}
+			}
+			row(abcd, s->mount, x_re, x_im, m);
+		}
+		kernels::cdiv(x_re, x_im, abcd.a_re, abcd.a_im, abcd.c_re, abcd.c_im, m);
+		for (std::size_t i = 0; i < m; i++) {
+			zin[k + i] = cxd_t(x_re[i], x_im[i]);
+		}
+	}
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef INCLUDED_CASPORT_SRC_RANDOM_H
+#define INCLUDED_CASPORT_SRC_RANDOM_H
+
+#include <cmath>
+#include <cstdint>
+#include "../include/casport_montecarlo.h"
+
+// Counter based Monte Carlo draws, shared by the CPU path and device.cu so a
+// trial gets the same element values on either backend
+#ifdef __CUDACC__
+#define CASPORT_HOST_DEVICE __host__ __device__
+#else
+#define CASPORT_HOST_DEVICE
+#endif
+
+namespace casport {
+namespace random {
+
+// splitmix64 finalizer
+CASPORT_HOST_DEVICE inline std::uint64_t
+mix(std::uint64_t z) {
+	z += 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1), a pure function of its arguments
+CASPORT_HOST_DEVICE inline double
+uniform(const std::uint64_t seed, const std::uint64_t i, const std::uint64_t trial, const std::uint64_t k) {
+	const std::uint64_t h = mix(mix(mix(mix(seed) ^ i) ^ trial) ^ k);
+	return (h >> 11) * 0x1.0p-53;
+}
+
+// Value multiplier of element i in a trial
+CASPORT_HOST_DEVICE inline double
+scale(const tolerance_t t, const std::uint64_t seed, const std::uint64_t i, const std::uint64_t trial) {
+	switch (t.dist) {
+	case UNIFORM:
+		return 1.0 + t.tol * (2.0 * uniform(seed, i, trial, 0) - 1.0);
+	case GAUSSIAN: {
+		// Box-Muller, u1 in (0, 1]
+		const double u1 = 1.0 - uniform(seed, i, trial, 0);
+		const double u2 = uniform(seed, i, trial, 1);
+		return 1.0 + t.tol * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+		}
+	case FIXED:
+		break;
+	}
+	return 1.0;
+}
+
+}
+}
+
+#endif //INCLUDED_CASPORT_SRC_RANDOM_H
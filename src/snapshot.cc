@@ -0,0 +1,43 @@
+#include "../include/casport_snapshot.h"
+
+namespace casport{
+
+shared_circuit::shared_circuit(const circuit &c) :
+	m_current(std::make_shared<const circuit>(c)), m_version(0) {
+}
+
+shared_circuit::shared_circuit(circuit &&c) :
+	m_current(std::make_shared<const circuit>(std::move(c))), m_version(0) {
+}
+
+void
+shared_circuit::store(circuit_snapshot_t next) {
+	// The version count moves after the pointer, so a reader that sees the new
+	// count also sees the new circuit
+	std::atomic_store_explicit(&m_current, std::move(next), std::memory_order_release);
+	m_version.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void
+shared_circuit::publish(const circuit &c) {
+	circuit_snapshot_t next = std::make_shared<const circuit>(c);
+	std::lock_guard<std::mutex> guard(m_write);
+	store(std::move(next));
+}
+
+void
+shared_circuit::publish(circuit &&c) {
+	circuit_snapshot_t next = std::make_shared<const circuit>(std::move(c));
+	std::lock_guard<std::mutex> guard(m_write);
+	store(std::move(next));
+}
+
+void
+shared_circuit::update(const std::function<void(circuit &c)> &edit) {
+	std::lock_guard<std::mutex> guard(m_write);
+	std::shared_ptr<circuit> next = std::make_shared<circuit>(*snapshot());
+	edit(*next);
+	store(std::move(next));
+}
+
+}
@@ -0,0 +1,327 @@
+#include "../include/casport_synthesis.h"
+#include <algorithm>
+#include <limits>
+
+namespace casport{
+
+namespace {
+struct slot {
+	element_t component; // CAP or IND
+	mount_t mount;
+};
+
+// Ladder from the load towards the input with its fitted values
+struct candidate {
+	std::vector<slot> ladder;
+	std::vector<double> values;
+	std::vector<cxd_t> zin; // over the band grid
+	double gamma;
+};
+
+struct band {
+	std::vector<double> f;
+	cxd_t zs;
+	double fc; // center [Hz]
+	double log_c[2];
+	double log_l[2];
+};
+}
+
+// |Gamma| of z against the source, the same for admittances y and 1/zs
+static double
+mismatch(const cxd_t z, const cxd_t zs) {
+	return std::abs(z - std::conj(zs)) / std::abs(z + zs);
+}
+
+// Reactance sign a slot adds, in impedance for series and admittance for shunt
+static double
+sign(const slot s) {
+	return ((s.mount == SERIES) == (s.component == IND)) ? 1.0 : -1.0;
+}
+
+// Value of a slot whose immittance at w has magnitude x
+static double
+value_for(const slot s, const double x, const double w) {
+	return (sign(s) > 0.0) ? x / w : 1.0 / (w * x);
+}
+
+static circuit
+build(const circuit &load, const std::vector<slot> &ladder, const std::vector<double> &values) {
+	circuit c(load);
+	c.reserve(load.size() + ladder.size());
+	for (std::size_t j = 0; j < ladder.size(); j++) {
+		c.push_front(element(ladder[j].component, ladder[j].mount, values[j]));
+	}
+	return c;
+}
+
+// Solves a x = b in place of b, a is k x k row major, by elimination with pivoting
+static bool
+solve(std::vector<double> &a, std::vector<double> &b, const std::size_t k) {
+	for (std::size_t i = 0; i < k; i++) {
+		std::size_t p = i;
+		for (std::size_t r = i + 1; r < k; r++) { if (std::fabs(a[r * k + i]) > std::fabs(a[p * k + i])) { p = r; } }
+		if (!(std::fabs(a[p * k + i]) > 0.0)) { return false; }
+		if (p != i) {
+			for (std::size_t j = 0; j < k; j++) { std::swap(a[i * k + j], a[p * k + j]); }
+			std::swap(b[i], b[p]);
+		}
+		for (std::size_t r = i + 1; r < k; r++) {
+			const double m = a[r * k + i] / a[i * k + i];
+			for (std::size_t j = i; j < k; j++) { a[r * k + j] -= m * a[i * k + j]; }
+			b[r] -= m * b[i];
+		}
+	}
+	for (std::size_t i = k; i-- > 0;) {
+		for (std::size_t j = i + 1; j < k; j++) { b[i] -= a[i * k + j] * b[j]; }
+		b[i] /= a[i * k + i];
+	}
+	return true;
+}
+
+// Levenberg-Marquardt on u = log(value) for the least squares of Gamma over
+// the band. Ladder slot j is element k-1-j of c. Returns the worst |Gamma|.
+// With relax set the residual is instead the mismatch left once a reactance
+// of that mount cancels the imaginary part at every point, the real part of
+// z (series) or 1/z (shunt) against the source, and the result is its RMS.
+static double
+fit(circuit &c, const std::vector<slot> &ladder, std::vector<double> &values, const band &b,
+	const std::size_t iterations, std::vector<cxd_t> &zin, const mount_t *relax = nullptr) {
+	const std::size_t k = ladder.size(), n = b.f.size();
+	const std::size_t rows = (relax == nullptr) ? 2 : 1; // per point
+	const bool admittance = (relax != nullptr && *relax == SHUNT);
+	const double rs = admittance ? std::real(1.0 / b.zs) : std::real(b.zs);
+	std::vector<double> u(k), lo(k), hi(k);
+	for (std::size_t j = 0; j < k; j++) {
+		const double *range = (ladder[j].component == CAP) ? b.log_c : b.log_l;
+		lo[j] = range[0];
+		hi[j] = range[1];
+		u[j] = std::clamp(std::log(values[j]), lo[j], hi[j]);
+	}
+	// Residuals of one point, and their derivatives along dz
+	const auto residual = [&](const cxd_t z, double *r) {
+		if (relax == nullptr) {
+			const cxd_t gamma = (z - std::conj(b.zs)) / (z + b.zs);
+			r[0] = std::real(gamma);
+			r[1] = std::imag(gamma);
+		} else {
+			const double x = std::real(admittance ? 1.0 / z : z);
+			r[0] = (x - rs) / (x + rs);
+		}
+	};
+	const auto derivative = [&](const cxd_t z, const cxd_t dz, double *d) {
+		if (relax == nullptr) {
+			const cxd_t dgamma = 2.0 * std::real(b.zs) / ((z + b.zs) * (z + b.zs)) * dz;
+			d[0] = std::real(dgamma);
+			d[1] = std::imag(dgamma);
+		} else {
+			const double x = std::real(admittance ? 1.0 / z : z);
+			const double dx = std::real(admittance ? -dz / (z * z) : dz);
+			d[0] = 2.0 * rs / ((x + rs) * (x + rs)) * dx;
+		}
+	};
+	zin.resize(n);
+	// Sum of squared residuals at x, left in values, c and zin
+	const auto cost = [&](const std::vector<double> &x) {
+		for (std::size_t j = 0; j < k; j++) {
+			values[j] = std::exp(x[j]);
+			c.set_value(c.handle(k - 1 - j), values[j]);
+		}
+		c.input_impedance(b.f.data(), n, zin.data());
+		double s = 0.0, r[2];
+		for (std::size_t p = 0; p < n; p++) {
+			residual(zin[p], r);
+			for (std::size_t i = 0; i < rows; i++) { s += r[i] * r[i]; }
+		}
+		return std::isfinite(s) ? s : std::numeric_limits<double>::infinity();
+	};
+
+	double s = cost(u);
+	double lambda = 1.0e-3;
+	std::vector<cxd_t> grad(c.size());
+	std::vector<double> jac(rows * n * k), res(rows * n), h(k * k), g(k), step(k), trial(k);
+	for (std::size_t it = 0; it < iterations && s > 0.0; it++) {
+		for (std::size_t p = 0; p < n; p++) {
+			c.set_frequency(b.f[p]);
+			c.sensitivities(grad.data());
+			const cxd_t z = c.input_impedance();
+			residual(z, &res[rows * p]);
+			for (std::size_t j = 0; j < k; j++) {
+				double d[2];
+				derivative(z, grad[k - 1 - j] * values[j], d);
+				for (std::size_t i = 0; i < rows; i++) { jac[(rows * p + i) * k + j] = d[i]; }
+			}
+		}
+		for (std::size_t i = 0; i < k; i++) {
+			g[i] = 0.0;
+			for (std::size_t r = 0; r < rows * n; r++) { g[i] += jac[r * k + i] * res[r]; }
+			for (std::size_t j = 0; j < k; j++) {
+				double a = 0.0;
+				for (std::size_t r = 0; r < rows * n; r++) { a += jac[r * k + i] * jac[r * k + j]; }
+				h[i * k + j] = a;
+			}
+		}
+		bool improved = false;
+		double s_new = s;
+		while (lambda < 1.0e12) {
+			std::vector<double> a(h);
+			for (std::size_t i = 0; i < k; i++) {
+				a[i * k + i] += lambda * a[i * k + i] + 1.0e-15;
+				step[i] = -g[i];
+			}
+			if (solve(a, step, k)) {
+				for (std::size_t j = 0; j < k; j++) { trial[j] = std::clamp(u[j] + step[j], lo[j], hi[j]); }
+				s_new = cost(trial);
+				if (s_new < s) {
+					improved = true;
+					break;
+				}
+			}
+			lambda *= 4.0;
+		}
+		if (!improved) { break; }
+		lambda = std::max(lambda / 3.0, 1.0e-9);
+		u.swap(trial);
+		const bool done = (s - s_new) <= 1.0e-10 * s;
+		s = s_new;
+		if (done) { break; }
+	}
+	s = cost(u);
+	if (relax != nullptr) { return std::sqrt(s / static_cast<double>(n)); }
+	double worst = 0.0;
+	for (std::size_t p = 0; p < n; p++) { worst = std::max(worst, mismatch(zin[p], b.zs)); }
+	return std::isfinite(worst) ? worst : std::numeric_limits<double>::infinity();
+}
+
+synthesis_t
+synthesize(thread_pool &pool, const circuit &load, const synthesis_options_t &options) {
+	band b;
+	const std::size_t points = std::max<std::size_t>(1, options.points);
+	for (std::size_t p = 0; p < points; p++) {
+		b.f.push_back((points == 1) ? options.f_lo :
+			options.f_lo + (options.f_hi - options.f_lo) * static_cast<double>(p) / static_cast<double>(points - 1));
+	}
+	b.zs = options.z_source;
+	b.fc = 0.5 * (options.f_lo + options.f_hi);
+	b.log_c[0] = std::log(options.c_min);
+	b.log_c[1] = std::log(options.c_max);
+	b.log_l[0] = std::log(options.l_min);
+	b.log_l[1] = std::log(options.l_max);
+	const double w = 2.0 * M_PI * b.fc;
+	const std::size_t keep = std::max<std::size_t>(1, options.results);
+
+	synthesis_t out{ {}, 0, 0 };
+	std::vector<candidate> best; // by gamma, then length
+	std::vector<candidate> live(1);
+	live[0].zin.resize(b.f.size());
+	// Not memoized, the caller's cached sweep of load stays
+	load.input_impedance(b.f.data(), b.f.size(), live[0].zin.data(), DOUBLE_PRECISION);
+	live[0].gamma = std::numeric_limits<double>::infinity();
+	static const slot SLOTS[4] = { { CAP, SHUNT }, { IND, SHUNT }, { CAP, SERIES }, { IND, SERIES } };
+
+	// One level of the tree per pass, its ladders fitted in parallel against
+	// the results of the levels before, so the search does not depend on timing
+	for (std::size_t depth = 1; depth <= options.max_elements && !live.empty(); depth++) {
+		struct task {
+			std::size_t parent;
+			slot s;
+		};
+		std::vector<task> tasks;
+		for (std::size_t i = 0; i < live.size(); i++) {
+			for (const slot s : SLOTS) {
+				const std::vector<slot> &l = live[i].ladder;
+				if (!l.empty() && s.mount == l.back().mount && s.component <= l.back().component) { continue; }
+				tasks.push_back(task{ i, s });
+			}
+		}
+		const double threshold = (best.size() < keep) ? std::numeric_limits<double>::infinity() : best.back().gamma;
+		const bool last = (depth == options.max_elements);
+		// Leaves are screened per parent and mount by a relaxed refit of the
+		// parent. Its RMS mismatch estimates what a child on that mount can
+		// reach, a local fit and not a bound, so this prunes heuristically.
+		if (last && std::isfinite(threshold)) {
+			std::vector<double> bounds(2 * live.size(), 0.0);
+			std::vector<char> wanted(bounds.size(), 0);
+			for (const task &t : tasks) { wanted[2 * t.parent + ((t.s.mount == SHUNT) ? 0 : 1)] = 1; }
+			pool.parallel_for(bounds.size(), [&](const std::size_t t) {
+				const candidate &parent = live[t / 2];
+				const mount_t m = (t % 2 == 0) ? SHUNT : SERIES;
+				if (!wanted[t] || parent.ladder.empty()) { return; }
+				std::vector<double> values(parent.values);
+				std::vector<cxd_t> zin;
+				circuit c = build(load, parent.ladder, values);
+				bounds[t] = fit(c, parent.ladder, values, b, options.iterations, zin, &m);
+			});
+			std::vector<task> kept;
+			for (const task &t : tasks) {
+				if (bounds[2 * t.parent + ((t.s.mount == SHUNT) ? 0 : 1)] >= threshold) {
+					out.pruned++;
+				} else {
+					kept.push_back(t);
+				}
+			}
+			tasks.swap(kept);
+		}
+		std::vector<candidate> made(tasks.size());
+		pool.parallel_for(tasks.size(), [&](const std::size_t t) {
+			const candidate &parent = live[tasks[t].parent];
+			const slot s = tasks[t].s;
+			const cxd_t ps = (s.mount == SERIES) ? b.zs : 1.0 / b.zs;
+			// Starts: the value cancelling the reactance at the center, if the
+			// sign allows, and a small and a large one about the source
+			const std::size_t c_mid = b.f.size() / 2;
+			const cxd_t p = (s.mount == SERIES) ? parent.zin[c_mid] : 1.0 / parent.zin[c_mid];
+			const double x = -(std::imag(p) + std::imag(ps)) * sign(s);
+			std::vector<double> starts;
+			if (x > 0.0) { starts.push_back(value_for(s, x, w)); }
+			const double nominal = std::abs((s.mount == SERIES) ? b.zs : 1.0 / b.zs);
+			starts.push_back(value_for(s, 0.3 * nominal, w));
+			starts.push_back(value_for(s, 3.0 * nominal, w));
+
+			candidate &child = made[t];
+			child.ladder = parent.ladder;
+			child.ladder.push_back(s);
+			child.gamma = std::numeric_limits<double>::infinity();
+			std::vector<double> values;
+			std::vector<cxd_t> zin;
+			for (const double v : starts) {
+				values = parent.values;
+				values.push_back(v);
+				circuit c = build(load, child.ladder, values);
+				const double gamma = fit(c, child.ladder, values, b, options.iterations, zin);
+				if (gamma < child.gamma) {
+					child.gamma = gamma;
+					child.values = values;
+					child.zin = zin;
+				}
+			}
+		});
+
+		std::vector<candidate> next;
+		for (std::size_t t = 0; t < tasks.size(); t++) {
+			out.candidates++;
+			candidate &c = made[t];
+			if (best.size() < keep || c.gamma < best.back().gamma) {
+				// Shorter ladders come first, so equal ones stay ahead
+				const auto at = std::upper_bound(best.begin(), best.end(), c.gamma,
+					[](const double g, const candidate &e) { return g < e.gamma; });
+				best.insert(at, c);
+				if (best.size() > keep) { best.pop_back(); }
+			}
+			if (!last && c.gamma > options.goal) { next.push_back(std::move(c)); }
+		}
+		live.swap(next);
+	}
+
+	for (const candidate &c : best) {
+		out.networks.push_back(match_result_t{ build(load, c.ladder, c.values), c.ladder.size(), c.gamma });
+	}
+	return out;
+}
+
+synthesis_t
+synthesize(thread_pool &pool, const cxd_t z_load, const synthesis_options_t &options) {
+	return synthesize(pool, circuit(z_load), options);
+}
+
+}
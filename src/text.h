@@ -0,0 +1,72 @@
+#ifndef INCLUDED_CASPORT_SRC_TEXT_H
+#define INCLUDED_CASPORT_SRC_TEXT_H
+
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+
+// In place tokenizing shared by the text format readers, tokens are views
+// into the input and nothing is allocated
+namespace casport {
+namespace text {
+
+inline bool
+is_blank(const char c) {
+	return (c == ' ' || c == '\t' || c == '\r');
+}
+
+// Splits the next line off text, false at the end
+inline bool
+next_line(std::string_view &text, std::string_view &line) {
+	if (text.empty()) { return false; }
+	std::size_t eol = text.find('\n');
+	if (eol == std::string_view::npos) { eol = text.size(); }
+	line = text.substr(0, eol);
+	text.remove_prefix(std::min(eol + 1, text.size()));
+	return true;
+}
+
+// Splits the next token off line, false at the end of the line or at a comment
+inline bool
+next_token(std::string_view &line, std::string_view &token, const char comment) {
+	std::size_t i = 0;
+	while (i < line.size() && is_blank(line[i])) { i++; }
+	if (i == line.size() || line[i] == comment) { line = std::string_view(); return false; }
+	std::size_t j = i;
+	while (j < line.size() && !is_blank(line[j]) && line[j] != comment) { j++; }
+	token = line.substr(i, j - i);
+	line.remove_prefix(j);
+	return true;
+}
+
+// Case insensitive compare against a lower case keyword
+inline bool
+is_keyword(const std::string_view token, const std::string_view keyword) {
+	if (token.size() != keyword.size()) { return false; }
+	for (std::size_t i = 0; i < token.size(); i++) {
+		const char c = (token[i] >= 'A' && token[i] <= 'Z') ? token[i] - 'A' + 'a' : token[i];
+		if (c != keyword[i]) { return false; }
+	}
+	return true;
+}
+
+// Whole token as a number, rest points past the digits
+inline bool
+to_number(const std::string_view token, double &v, std::string_view &rest) {
+	const char *end = token.data() + token.size();
+	const std::from_chars_result r = std::from_chars(token.data(), end, v);
+	if (r.ec != std::errc()) { return false; }
+	rest = std::string_view(r.ptr, end - r.ptr);
+	return true;
+}
+
+inline bool
+to_number(const std::string_view token, double &v) {
+	std::string_view rest;
+	return to_number(token, v, rest) && rest.empty();
+}
+
+}
+}
+
+#endif //INCLUDED_CASPORT_SRC_TEXT_H
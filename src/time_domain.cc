@@ -0,0 +1,192 @@
+#include "../include/casport_time_domain.h"
+#include <algorithm>
+#include <cmath>
+
+namespace casport{
+
+// Modified Bessel function I0, series to full double precision
+static double
+bessel_i0(const double x) {
+	const double q = 0.25 * x * x;
+	double sum = 1.0, term = 1.0;
+	for (std::size_t k = 1; term > 1.0e-17 * sum; k++) {
+		term *= q / static_cast<double>(k * k);
+		sum += term;
+	}
+	return sum;
+}
+
+time_domain::time_domain(const time_domain_options_t &options) {
+	const std::size_t p = std::max<std::size_t>(options.points, 1);
+	const double df = options.f_max / static_cast<double>(p);
+	m_frequencies.resize(p + 1);
+	m_window.resize(p + 1);
+	for (std::size_t k = 0; k <= p; k++) {
+		m_frequencies[k] = df * static_cast<double>(k);
+		// Falls to zero one bin past f_max
+		const double x = static_cast<double>(k) / static_cast<double>(p + 1);
+		if (options.window == HANN_WINDOW) {
+			m_window[k] = 0.5 * (1.0 + std::cos(M_PI * x));
+		} else if (options.window == KAISER_WINDOW) {
+			m_window[k] = bessel_i0(options.beta * std::sqrt(1.0 - x * x)) / bessel_i0(options.beta);
+		} else {
+			m_window[k] = 1.0;
+		}
+	}
+	m_samples = 2;
+	while (m_samples < std::max(options.samples, 2 * (p + 1))) { m_samples *= 2; }
+	m_dt = 1.0 / (static_cast<double>(m_samples) * df);
+	double area = m_window[0];
+	for (std::size_t k = 1; k <= p; k++) { area += 2.0 * m_window[k]; }
+	m_impulse_scale = static_cast<double>(m_samples) / area;
+
+	const std::size_t m = m_samples / 2;
+	m_twiddles.resize(m / 2 + 1);
+	for (std::size_t k = 0; k < m_twiddles.size(); k++) {
+		m_twiddles[k] = std::polar(1.0, 2.0 * M_PI * static_cast<double>(k) / static_cast<double>(m));
+	}
+	m_spin.resize(m);
+	for (std::size_t k = 0; k < m; k++) {
+		m_spin[k] = std::polar(1.0, 2.0 * M_PI * static_cast<double>(k) / static_cast<double>(m_samples));
+	}
+	m_reverse.resize(m);
+	std::size_t bits = 0;
+	while ((std::size_t(1) << bits) < m) { bits++; }
+	for (std::size_t k = 0; k < m; k++) {
+		std::size_t r = 0;
+		for (std::size_t b = 0; b < bits; b++) { r |= ((k >> b) & 1) << (bits - 1 - b); }
+		m_reverse[k] = r;
+	}
+	m_fft.resize(m);
+	m_spectrum.resize(p + 1);
+	m_waveform.resize(m_samples);
+}
+
+// H(0) of a reflection or transfer function is real, taken on the line
+// through the real parts at f_1 and f_2
+void
+time_domain::extrapolate_dc(cxd_t *h) const {
+	const double h1 = std::real(h[1]);
+	h[0] = (points() > 2) ? 2.0 * h1 - std::real(h[2]) : h1;
+}
+
+// x[n] = 1/N sum_k X[k] exp(j 2 pi k n / N) of the conjugate symmetric X by one
+// complex FFT of N/2 points: z[m] = x[2m] + j x[2m+1] is the transform of
+// X[k] + conj(X[N/2-k]) + j (X[k] - conj(X[N/2-k])) exp(j 2 pi k / N)
+void
+time_domain::inverse(const cxd_t *h, const response_t response, double *y) {
+	const std::size_t m = m_samples / 2, p = points() - 1;
+	auto bin = [&](const std::size_t k) -> cxd_t {
+		if (k == 0) { return cxd_t(std::real(h[0]) * m_window[0], 0.0); }
+		return (k <= p) ? h[k] * m_window[k] : cxd_t(0.0, 0.0); // 2 (p + 1) <= N, bin N/2 is padding
+	};
+	for (std::size_t k = 0; k < m; k++) {
+		const cxd_t a = bin(k), b = std::conj(bin(m - k));
+		m_fft[m_reverse[k]] = (a + b) + cxd_t(0.0, 1.0) * (a - b) * m_spin[k];
+	}
+	// Radix 2, in place, exp(+j) twiddles
+	for (std::size_t len = 2; len <= m; len *= 2) {
+		const std::size_t half = len / 2, step = m / len;
+		for (std::size_t i = 0; i < m; i += len) {
+			for (std::size_t j = 0; j < half; j++) {
+				const cxd_t t = m_fft[i + j + half] * m_twiddles[j * step];
+				m_fft[i + j + half] = m_fft[i + j] - t;
+				m_fft[i + j] += t;
+			}
+		}
+	}
+	const double scale = 1.0 / static_cast<double>(m_samples);
+	if (response == IMPULSE_RESPONSE) {
+		for (std::size_t i = 0; i < m; i++) {
+			y[2 * i] = std::real(m_fft[i]) * scale * m_impulse_scale;
+			y[2 * i + 1] = std::imag(m_fft[i]) * scale * m_impulse_scale;
+		}
+	} else {
+		// The impulse at t = 0 is split between both ends of the record, so the
+		// sum starts at -N/2 dt with the second half taken as negative times
+		double sum = 0.0;
+		for (std::size_t i = m / 2; i < m; i++) {
+			sum += (std::real(m_fft[i]) + std::imag(m_fft[i])) * scale;
+		}
+		for (std::size_t i = 0; i < m; i++) {
+			if (i == m / 2) { sum = 0.0; }
+			sum += std::real(m_fft[i]) * scale;
+			y[2 * i] = sum;
+			sum += std::imag(m_fft[i]) * scale;
+			y[2 * i + 1] = sum;
+		}
+	}
+}
+
+void
+time_domain::transform(const cxd_t *h, const std::size_t count, const response_t response,
+	const std::function<void(const std::size_t i, const double *y)> &emit) {
+	for (std::size_t i = 0; i < count; i++) {
+		inverse(h + i * points(), response, m_waveform.data());
+		emit(i, m_waveform.data());
+	}
+}
+
+void
+time_domain::transform(const cxd_t *h, const std::size_t count, const response_t response, double *y) {
+	for (std::size_t i = 0; i < count; i++) {
+		inverse(h + i * points(), response, y + i * m_samples);
+	}
+}
+
+// Step of the reflection to the impedance seen at each time
+static void
+impedance_profile(const double z_ref, const std::size_t n, double *y) {
+	for (std::size_t i = 0; i < n; i++) {
+		y[i] = z_ref * (1.0 + y[i]) / (1.0 - y[i]);
+	}
+}
+
+void
+time_domain::tdr(const circuit &c, const double z_ref, double *z) {
+	const std::size_t p = points() - 1;
+	c.input_impedance(frequencies() + 1, p, m_spectrum.data() + 1);
+	for (std::size_t k = 1; k <= p; k++) { m_spectrum[k] = reflection(m_spectrum[k], z_ref); }
+	extrapolate_dc(m_spectrum.data());
+	inverse(m_spectrum.data(), STEP_RESPONSE, z);
+	impedance_profile(z_ref, m_samples, z);
+}
+
+// Variants are swept SWEEP_BLOCK at a time so the sweep buffer stays small
+void
+time_domain::tdr(const circuit_batch &b, const double z_ref,
+	const std::function<void(const std::size_t v, const double *z)> &emit) {
+	const std::size_t p = points() - 1;
+	m_sweep.resize(SWEEP_BLOCK * p);
+	for (std::size_t first = 0; first < b.variants(); first += SWEEP_BLOCK) {
+		const std::size_t count = std::min(SWEEP_BLOCK, b.variants() - first);
+		b.input_impedance(frequencies() + 1, p, first, count, m_sweep.data());
+		for (std::size_t v = 0; v < count; v++) {
+			for (std::size_t k = 1; k <= p; k++) { m_spectrum[k] = reflection(m_sweep[v * p + k - 1], z_ref); }
+			extrapolate_dc(m_spectrum.data());
+			inverse(m_spectrum.data(), STEP_RESPONSE, m_waveform.data());
+			impedance_profile(z_ref, m_samples, m_waveform.data());
+			emit(first + v, m_waveform.data());
+		}
+	}
+}
+
+void
+time_domain::two_port(const circuit &c, const parameters_t to, const std::size_t parameter, const double z_ref,
+	const response_t response, double *y) {
+	const std::size_t p = points() - 1;
+	m_parameters.resize(8 * p);
+	network_soa_t out;
+	for (std::size_t j = 0; j < 4; j++) {
+		out.re[j] = m_parameters.data() + j * p;
+		out.im[j] = m_parameters.data() + (4 + j) * p;
+	}
+	sweep(c, frequencies() + 1, p, to, z_ref, out);
+	for (std::size_t k = 1; k <= p; k++) {
+		m_spectrum[k] = cxd_t(out.re[parameter][k - 1], out.im[parameter][k - 1]);
+	}
+	extrapolate_dc(m_spectrum.data());
+	inverse(m_spectrum.data(), response, y);
+}
+
+}
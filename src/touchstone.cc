@@ -0,0 +1,239 @@
+#include "../include/casport_touchstone.h"
+#include "../include/casport_network.h"
+#include "text.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace casport{
+
+static constexpr std::size_t WRITE_BUFFER = 1 << 16;
+static constexpr std::size_t NUMBER_CHARS = 32; // separator and the longest shortest form of a double
+static constexpr std::size_t TOUCHSTONE_PAIRS_PER_LINE = 4; // most data pairs on a line, Touchstone 1.0
+
+// File order of the two-port pairs, N11 N21 N12 N22, as row major indices
+static constexpr std::size_t TWO_PORT_ORDER[4] = { 0, 2, 1, 3 };
+
+static inline std::size_t
+file_index(const std::size_t ports, const std::size_t q) {
+	return (ports == 2) ? TWO_PORT_ORDER[q] : q;
+}
+
+touchstone_writer::touchstone_writer(std::FILE *out, const std::size_t ports, const double z_ref,
+	const touchstone_format_t format) :
+	m_out(out), m_ports(ports), m_z_ref(z_ref), m_format(format), m_buffer(WRITE_BUFFER), m_used(0), m_good(true) {
+	static const char *formats[] = { "RI", "MA", "DB" };
+	const int len = std::snprintf(m_buffer.data(), m_buffer.size(), "! casport\n# Hz S %s R", formats[format]);
+	m_used = static_cast<std::size_t>(len);
+	put(z_ref);
+	m_buffer[m_used++] = '\n';
+}
+
+touchstone_writer::~touchstone_writer() {
+	flush();
+}
+
+// Room for n more characters
+void
+touchstone_writer::reserve(const std::size_t n) {
+	if (m_used + n <= m_buffer.size()) { return; }
+	if (m_good && std::fwrite(m_buffer.data(), 1, m_used, m_out) != m_used) { m_good = false; }
+	m_used = 0;
+	if (n > m_buffer.size()) { m_buffer.resize(n); }
+}
+
+// Number, space separated unless at the start of a line
+void
+touchstone_writer::put(const double v) {
+	if (m_used > 0 && m_buffer[m_used - 1] != '\n') { m_buffer[m_used++] = ' '; }
+	char *end = m_buffer.data() + m_buffer.size();
+	m_used = std::to_chars(m_buffer.data() + m_used, end, v).ptr - m_buffer.data();
+}
+
+void
+touchstone_writer::put(const cxd_t v) {
+	switch (m_format) {
+	case RI:
+		put(std::real(v));
+		put(std::imag(v));
+		break;
+	case MA:
+		put(std::abs(v));
+		put(std::arg(v) * (180.0 / M_PI));
+		break;
+	case DB:
+		put(20.0 * std::log10(std::abs(v)));
+		put(std::arg(v) * (180.0 / M_PI));
+		break;
+	}
+}
+
+void
+touchstone_writer::write(const double *f, const std::size_t n, const cxd_t *s) {
+	const std::size_t values = m_ports * m_ports;
+	for (std::size_t k = 0; k < n; k++) {
+		reserve((1 + 2 * values) * NUMBER_CHARS + values + 1);
+		put(f[k]);
+		for (std::size_t q = 0; q < values; q++) {
+			put(s[k * values + file_index(m_ports, q)]);
+			// From 3 ports on every matrix row starts a line, of at most 4 pairs
+			const std::size_t column = q % m_ports + 1;
+			if (m_ports > 2 && q + 1 < values && (column == m_ports || column % TOUCHSTONE_PAIRS_PER_LINE == 0)) {
+				m_buffer[m_used++] = '\n';
+			}
+		}
+		m_buffer[m_used++] = '\n';
+	}
+}
+
+void
+touchstone_writer::write(const circuit &c, const double *f, const std::size_t n) {
+	// A circuit is a one- or two-port, there is no matrix for more ports
+	if (m_ports == 0 || m_ports > 2) {
+		m_good = false;
+		return;
+	}
+	std::vector<cxd_t> abcd(4 * std::min(n, TOUCHSTONE_CHUNK));
+	std::vector<cxd_t> s(m_ports * m_ports * std::min(n, TOUCHSTONE_CHUNK));
+	for (std::size_t k = 0; k < n; k += TOUCHSTONE_CHUNK) {
+		const std::size_t m = std::min(TOUCHSTONE_CHUNK, n - k);
+		if (m_ports == 1) {
+			// Not memoized, the chunks would evict the caller's cached sweep
+			c.input_impedance(f + k, m, s.data(), DOUBLE_PRECISION);
+			for (std::size_t i = 0; i < m; i++) { s[i] = reflection(s[i], m_z_ref); }
+		} else {
+			c.abcd(f + k, m, abcd.data());
+			for (std::size_t i = 0; i < m; i++) { s_from_abcd(abcd.data() + 4 * i, m_z_ref, s.data() + 4 * i); }
+		}
+		write(f + k, m, s.data());
+	}
+}
+
+bool
+touchstone_writer::flush() {
+	if (m_good && m_used > 0 && std::fwrite(m_buffer.data(), 1, m_used, m_out) != m_used) { m_good = false; }
+	m_used = 0;
+	if (m_good && std::fflush(m_out) != 0) { m_good = false; }
+	return m_good;
+}
+
+// Option line after the '#', "<unit> <parameter> <format> R <z_ref>" in any order
+static const char *
+parse_options(std::string_view line, double &unit, touchstone_format_t &format, double &z_ref) {
+	std::string_view token;
+	while (text::next_token(line, token, '!')) {
+		if (text::is_keyword(token, "hz")) { unit = 1.0; }
+		else if (text::is_keyword(token, "khz")) { unit = 1.0e3; }
+		else if (text::is_keyword(token, "mhz")) { unit = 1.0e6; }
+		else if (text::is_keyword(token, "ghz")) { unit = 1.0e9; }
+		else if (text::is_keyword(token, "s")) { }
+		else if (text::is_keyword(token, "y") || text::is_keyword(token, "z") ||
+			text::is_keyword(token, "g") || text::is_keyword(token, "h")) { return "only S parameters are supported"; }
+		else if (text::is_keyword(token, "ri")) { format = RI; }
+		else if (text::is_keyword(token, "ma")) { format = MA; }
+		else if (text::is_keyword(token, "db")) { format = DB; }
+		else if (text::is_keyword(token, "r")) {
+			if (!text::next_token(line, token, '!') || !text::to_number(token, z_ref)) { return "expected reference impedance"; }
+		} else {
+			return "unknown option";
+		}
+	}
+	return nullptr;
+}
+
+static inline cxd_t
+to_complex(const double a, const double b, const touchstone_format_t format) {
+	switch (format) {
+	case MA: return std::polar(a, b * (M_PI / 180.0));
+	case DB: return std::polar(std::pow(10.0, a / 20.0), b * (M_PI / 180.0));
+	case RI: break;
+	}
+	return cxd_t(a, b);
+}
+
+touchstone_error_t
+parse_touchstone(const std::string_view text, const std::size_t ports, touchstone_data_t &data) {
+	data.ports = ports;
+	data.z_ref = 50.0;
+	data.f.clear();
+	data.s.clear();
+	if (ports == 0) { return touchstone_error_t{ 0, "no ports" }; }
+	double unit = 1.0e9; // Touchstone defaults, # GHz S MA R 50
+	touchstone_format_t format = MA;
+	bool options = false;
+	const std::size_t values = ports * ports, per_point = 1 + 2 * values;
+	std::vector<double> point(per_point);
+	std::size_t count = 0, line_no = 0;
+	std::string_view rest = text, line, token;
+	while (text::next_line(rest, line)) {
+		line_no++;
+		if (!text::next_token(line, token, '!')) { continue; }
+		if (token[0] == '#') {
+			// Only the first option line counts
+			if (!options) {
+				line = std::string_view(token.data() + 1, line.data() + line.size() - token.data() - 1);
+				const char *error = parse_options(line, unit, format, data.z_ref);
+				if (error != nullptr) { return touchstone_error_t{ line_no, error }; }
+			}
+			options = true;
+			continue;
+		}
+		if (token[0] == '[') { return touchstone_error_t{ line_no, "Touchstone 2.0 keywords are not supported" }; }
+		do {
+			double v;
+			if (!text::to_number(token, v)) { return touchstone_error_t{ line_no, "bad number" }; }
+			if (count == 0) {
+				v *= unit;
+				// Two-port noise parameters follow the S data, starting at a lower frequency
+				if (ports == 2 && !data.f.empty() && v <= data.f.back()) { return touchstone_error_t{ 0, nullptr }; }
+			}
+			point[count++] = v;
+			if (count == per_point) {
+				data.f.push_back(point[0]);
+				const std::size_t k = data.s.size();
+				data.s.resize(k + values);
+				for (std::size_t q = 0; q < values; q++) {
+					data.s[k + file_index(ports, q)] = to_complex(point[1 + 2 * q], point[2 + 2 * q], format);
+				}
+				count = 0;
+			}
+		} while (text::next_token(line, token, '!'));
+	}
+	if (count != 0) { return touchstone_error_t{ line_no, "incomplete data point" }; }
+	return touchstone_error_t{ 0, nullptr };
+}
+
+// N of a .sNp file name, 0 if it has none
+static std::size_t
+ports_of(const char *path) {
+	const char *dot = std::strrchr(path, '.');
+	if (dot == nullptr || (dot[1] != 's' && dot[1] != 'S')) { return 0; }
+	std::size_t ports = 0;
+	const char *c = dot + 2;
+	for (; *c >= '0' && *c <= '9'; c++) { ports = 10 * ports + (*c - '0'); }
+	if (c == dot + 2 || (c[0] != 'p' && c[0] != 'P') || c[1] != '\0') { return 0; }
+	return ports;
+}
+
+touchstone_error_t
+read_touchstone(const char *path, touchstone_data_t &data) {
+	const std::size_t ports = ports_of(path);
+	if (ports == 0) { return touchstone_error_t{ 0, "file name is not .sNp" }; }
+	const int fd = ::open(path, O_RDONLY);
+	if (fd < 0) { return touchstone_error_t{ 0, "cannot open file" }; }
+	struct stat st;
+	if (::fstat(fd, &st) != 0) { ::close(fd); return touchstone_error_t{ 0, "cannot open file" }; }
+	const std::size_t size = static_cast<std::size_t>(st.st_size);
+	if (size == 0) { ::close(fd); return parse_touchstone(std::string_view(), ports, data); }
+	void *map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) { return touchstone_error_t{ 0, "cannot map file" }; }
+	::madvise(map, size, MADV_SEQUENTIAL);
+	const touchstone_error_t r = parse_touchstone(std::string_view(static_cast<const char *>(map), size), ports, data);
+	::munmap(map, size);
+	return r;
+}
+
+}
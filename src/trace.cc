@@ -0,0 +1,78 @@
+#include "trace.h"
+
+#ifdef CASPORT_TRACE
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace casport {
+namespace trace {
+
+namespace {
+// A sink and its context are published together. Bindings are immutable and
+// a replaced one is retired, freed by a later set_sink() once no step is in
+// flight, so a step running alongside uses an old or the new pair, never a
+// freed or mixed one.
+struct binding {
+	sink_t sink;
+	void *ctx;
+};
+std::atomic<const binding *> g_binding{nullptr};
+std::atomic<std::size_t> g_readers{0}; // steps between loading a binding and leaving its sink
+std::mutex g_bindings_lock;
+std::vector<std::unique_ptr<const binding>> g_retired;
+std::atomic<std::uint64_t> g_evaluations{0};
+std::atomic<std::uint64_t> g_element_updates{0};
+}
+
+void
+set_sink(sink_t sink, void *ctx) {
+	std::lock_guard<std::mutex> guard(g_bindings_lock);
+	const binding *current = g_binding.load(std::memory_order_relaxed);
+	if (current == nullptr ? sink == nullptr : (current->sink == sink && current->ctx == ctx)) { return; }
+	const binding *next = (sink != nullptr) ? new binding{ sink, ctx } : nullptr;
+	// Sequentially consistent with the reader count in step(): a step that
+	// counted itself after this exchange loads next, so none but a counted
+	// one can still hold a retired binding
+	g_binding.exchange(next);
+	if (current != nullptr) { g_retired.emplace_back(current); }
+	if (g_readers.load() == 0) { g_retired.clear(); }
+}
+
+counters_t
+counters() {
+	return counters_t{ g_evaluations.load(std::memory_order_relaxed),
+					   g_element_updates.load(std::memory_order_relaxed) };
+}
+
+void
+reset() {
+	g_evaluations.store(0, std::memory_order_relaxed);
+	g_element_updates.store(0, std::memory_order_relaxed);
+}
+
+bool
+has_sink() {
+	return g_binding.load(std::memory_order_relaxed) != nullptr;
+}
+
+void
+step(const std::size_t step, const std::complex<double> *abcd) {
+	g_readers.fetch_add(1);
+	const binding *b = g_binding.load();
+	if (b != nullptr) {
+		b->sink(b->ctx, step, abcd);
+	}
+	g_readers.fetch_sub(1, std::memory_order_release);
+}
+
+void
+count(const std::uint64_t evaluations, const std::uint64_t element_updates) {
+	g_evaluations.fetch_add(evaluations, std::memory_order_relaxed);
+	g_element_updates.fetch_add(element_updates, std::memory_order_relaxed);
+}
+
+}
+}
+#endif
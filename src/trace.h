@@ -0,0 +1,22 @@
+#ifndef INCLUDED_CASPORT_SRC_TRACE_H
+#define INCLUDED_CASPORT_SRC_TRACE_H
+
+#include "../include/casport_trace.h"
+
+// Hooks used inside the library, empty unless CASPORT_TRACE is defined
+#ifdef CASPORT_TRACE
+namespace casport {
+namespace trace {
+bool has_sink();
+void step(const std::size_t step, const std::complex<double> *abcd);
+void count(const std::uint64_t evaluations, const std::uint64_t element_updates);
+}
+}
+#define CASPORT_TRACE_STEP(i, abcd) casport::trace::step((i), (abcd))
+#define CASPORT_TRACE_COUNT(evals, updates) casport::trace::count((evals), (updates))
+#else
+#define CASPORT_TRACE_STEP(i, abcd) ((void)sizeof(i), (void)sizeof(abcd)) // unevaluated
+#define CASPORT_TRACE_COUNT(evals, updates) ((void)sizeof(evals), (void)sizeof(updates))
+#endif
+
+#endif //INCLUDED_CASPORT_SRC_TRACE_H